@@ -0,0 +1,126 @@
+#pragma once
+#ifndef _PAZUSOBA_API_H_
+#define _PAZUSOBA_API_H_
+
+#include "pazusoba.h"
+
+// The C interface of the shared library, support/pazusoba.py mirrors these
+// structs with ctypes. It isn't part of core.h because only the shared
+// library is built with src/api.cpp
+extern "C" {
+
+// Holds the row & column of where to go next
+struct c_location {
+    int row = -1;
+    int column = -1;
+};
+
+// C interface of pazusoba::state
+struct c_state {
+    int combo;
+    int max_combo;
+    int step;
+    int row;
+    int column;
+    bool goal;
+    // add the first step here as well
+    c_location routes[MAX_DEPTH + 1];
+    // TODO: this should be a c type not std::array but it works
+    pazusoba::game_board board;
+};
+
+// Compact interface of pazusoba::state, filled in place without allocating
+// the route as one location per step
+struct c_compact_state {
+    int combo;
+    int max_combo;
+    int step;
+    int row;
+    int column;
+    bool goal;
+    // board index of the first orb
+    int start;
+    // one pazusoba::DIRECTIONS value per step
+    unsigned char directions[MAX_DEPTH];
+    // straight segments of the route, only filled if asked for
+    int segment_count;
+    unsigned char segment_directions[MAX_DEPTH];
+    unsigned char segment_lengths[MAX_DEPTH];
+    // orbs after moving, ORB_WEB_NAME gives their names
+    unsigned char board[MAX_BOARD_LENGTH];
+    // combos erased for each orb including cascades, only filled if asked for
+    unsigned char colour_combo[ORB_COUNT];
+    // the board of a batch job is invalid, nothing else is filled
+    bool rejected;
+};
+
+// One board and its settings for adventureBatch()
+struct c_job {
+    const char* board;
+    int min_erase;
+    int search_depth;
+    int beam_size;
+    pazusoba::profile* profiles;
+    int count;
+};
+
+// Called with the job index as soon as it is done, one call at a time
+typedef void (*c_batch_callback)(int, const c_compact_state*);
+
+// Called with the committed route prefix whenever it grows
+typedef void (*c_commit_callback)(const c_state*);
+
+// C interface of pazusoba::profile_verdict
+struct c_verdict {
+    bool feasible;
+    bool relaxed;
+    int target;
+    int colour_target;
+};
+
+// C interface of pazusoba::progress
+struct c_progress {
+    int depth;
+    int best_score;
+    int best_combo;
+    long long expanded;
+    bool cancelled;
+    bool finished;
+};
+
+c_state adventure(int argc, char* argv[]);
+c_state adventureEx(const char*, int, int, int, pazusoba::profile*, int);
+// step 0 and combo -1 if the board is rejected
+c_state adventureCommitEx(const char*,
+                          int,
+                          int,
+                          int,
+                          pazusoba::profile*,
+                          int,
+                          double,
+                          c_commit_callback);
+void adventureBatch(const c_job*, int, int, c_compact_state*, c_batch_callback);
+// -1 if the board is rejected
+int feasibilityEx(const char*, int, pazusoba::profile*, int, c_verdict*);
+// shortened holds the last int chars, -1 if the new route doesn't fit
+int shortenEx(const char*, int, int, int, const char*, bool, bool, int, char*, int);
+
+// A solver kept between solves, solving returns false without touching the
+// result if the board is rejected, solverError() tells why
+void* solverCreate();
+void solverConfigure(void*, int, int, int, pazusoba::profile*, int);
+bool solverSolve(void*, const char*, c_state*);
+bool solverSolveCompact(void*, const char*, bool, bool, c_compact_state*);
+const char* solverError(void*);
+void solverFree(void*);
+
+// nullptr if the board is rejected
+void* adventureAsync(const char*, int, int, int, pazusoba::profile*, int);
+c_progress asyncProgress(void*);
+bool asyncDone(void*);
+void asyncCancel(void*);
+c_state asyncWait(void*);
+void asyncFree(void*);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef _PAZUSOBA_ASYNC_H_
+#define _PAZUSOBA_ASYNC_H_
+
+#include "pazusoba.h"
+#include <future>
+
+namespace pazusoba {
+
+// Run adventure() on its own thread, the solver is copied so profiles must
+// stay alive until the search is done
+class async_solve {
+    solver SOLVER;
+    search_progress PROGRESS;
+    std::future<state> FUTURE;
+    state RESULT;
+    bool WAITED = false;
+
+public:
+    explicit async_solve(const solver&);
+    // a running search is cancelled and joined
+    ~async_solve();
+    async_solve(const async_solve&) = delete;
+    async_solve& operator=(const async_solve&) = delete;
+
+    // the best state found so far is returned after cancelling
+    void cancel();
+    bool done() const;
+    progress snapshot() const { return PROGRESS.snapshot(); }
+    // block until the search is done
+    const state& wait();
+    const solver& owner() const { return SOLVER; }
+};
+
+}  // namespace pazusoba
+
+#endif
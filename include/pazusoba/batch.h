@@ -0,0 +1,28 @@
+#pragma once
+#ifndef _PAZUSOBA_BATCH_H_
+#define _PAZUSOBA_BATCH_H_
+
+#include "pazusoba.h"
+#include <functional>
+#include <vector>
+
+namespace pazusoba {
+
+struct batch_options {
+    // threads shared by every job, 0 uses one for each processor
+    int threads = 0;
+    // jobs with beam size times search depth up to this run one per thread,
+    // larger ones run one at a time with every thread
+    long long int split_threshold = 500000;
+    // called with the job index as soon as it is done, one call at a time
+    // but possibly from any thread
+    std::function<void(int, const state&)> on_result;
+};
+
+// Solve every configured solver, states are returned in the same order.
+// The threads and the workspace of every solver are restored afterwards
+std::vector<state> solve_batch(std::vector<solver>&, const batch_options&);
+
+}  // namespace pazusoba
+
+#endif
@@ -0,0 +1,67 @@
+//
+// bits.h
+// Bit scans and counts of 64 bit masks, GCC and Clang have builtins for
+// them, MSVC has intrinsics and anything else uses plain loops
+//
+
+#pragma once
+#ifndef _BITS_H_
+#define _BITS_H_
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace pazusoba {
+namespace bits {
+/// Index of the lowest set bit, the mask can't be 0
+inline int lowest(unsigned long long int mask) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int)index;
+#else
+    int index = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/// Index of the highest set bit which is floor(log2(mask)), the mask
+/// can't be 0
+inline int highest(unsigned long long int mask) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(mask);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return (int)index;
+#else
+    int index = 0;
+    while (mask >>= 1)
+        index++;
+    return index;
+#endif
+}
+
+/// Number of set bits
+inline int count(unsigned long long int mask) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(mask);
+#else
+    // __popcnt64 needs a cpu with popcnt so MSVC adds them up as well
+    mask = mask - ((mask >> 1) & 0x5555555555555555ULL);
+    mask = (mask & 0x3333333333333333ULL) + ((mask >> 2) & 0x3333333333333333ULL);
+    mask = (mask + (mask >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((mask * 0x0101010101010101ULL) >> 56);
+#endif
+}
+}  // namespace bits
+}  // namespace pazusoba
+
+#endif
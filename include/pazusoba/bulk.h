@@ -0,0 +1,37 @@
+#pragma once
+#ifndef _PAZUSOBA_BULK_H_
+#define _PAZUSOBA_BULK_H_
+
+#include "service.h"
+#include <string>
+
+namespace pazusoba {
+
+struct bulk_options {
+    // a file with one request per line or a board corpus, stdin if it is
+    // empty or -
+    std::string path;
+    // boards solved at the same time, they share the threads
+    int jobs = 1;
+    // 0 uses one for each processor
+    int threads = 0;
+    // key=value options for every line, see service.h, lines can override
+    std::string defaults;
+    // a solution cache file, see cache.h. Empty turns it off
+    std::string cache;
+    int cache_size = 16384;
+};
+
+// Solve every line and print one result line for each in the same order,
+// empty lines and lines starting with # are skipped. Requests without an
+// id get their line number, corpus boards their index from 1. Returns the
+// exit code
+int run_bulk(const bulk_options&);
+
+// Pack request lines into a board corpus, only the board, blocked= and
+// expected=combo are kept. Every board needs the same size
+int run_pack(const std::string&, const std::string&);
+
+}  // namespace pazusoba
+
+#endif
@@ -0,0 +1,148 @@
+#pragma once
+#ifndef _PAZUSOBA_CACHE_H_
+#define _PAZUSOBA_CACHE_H_
+
+#include "pazusoba.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pazusoba {
+
+#define CACHE_VERSION 1
+// entries of a set, the least recently used one is evicted when it is full
+#define CACHE_WAYS 8
+// directions packed 2 in a byte
+#define CACHE_ROUTE_BYTES 172
+#define CACHE_SEED 14695981039346656037ULL
+
+// FNV-1a over the bytes of a value, settings of a search are mixed into a
+// number with it. djb2 spreads small numbers too little for the set index
+inline unsigned long long int cache_mix(unsigned long long int hash, long long int value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The same board as every board it can be turned into by mirroring it
+// horizontally or relabelling the colours no profile asks for. Solutions
+// are stored in this frame and turned back for the caller
+class canonical_board {
+    int ROWS = 0;
+    int COLUMNS = 0;
+    game_board BOARD{};
+    unsigned long long int BLOCKED = 0;
+    bool MIRRORED = false;
+    orb TO_CALLER[ORB_COUNT]{};
+    orb TO_CANONICAL[ORB_COUNT]{};
+
+public:
+    // fixed orbs keep their colour, empty orbs always do
+    canonical_board(const game_board&,
+                    int,
+                    int,
+                    const std::array<bool, MAX_BOARD_LENGTH>&,
+                    const bool*);
+
+    const game_board& board() const { return BOARD; }
+    unsigned long long int blocked() const { return BLOCKED; }
+    bool mirrored() const { return MIRRORED; }
+    int size() const { return ROWS * COLUMNS; }
+    // mirroring twice is the same board, these work both ways
+    int position(int) const;
+    int direction(int) const;
+    orb to_caller(orb o) const { return TO_CALLER[o]; }
+    orb to_canonical(orb o) const { return TO_CANONICAL[o]; }
+    // the board after a route as seen by the other frame
+    game_board to_caller(const game_board&) const;
+    game_board to_canonical(const game_board&) const;
+};
+
+// What is kept for a board, either from adventure() or solve_shape()
+struct cached_solution {
+    bool success = false;
+    int begin = -1;
+    int combo = 0;
+    int max_combo = 0;
+    // solve_shape() only
+    int colour = 0;
+    game_board final_board{};
+    std::vector<int> directions;
+};
+
+// One slot of the file, it is mapped as it is so the layout is fixed and
+// the byte order is the one of the machine which wrote it
+struct cache_entry {
+    // 0 means the slot is empty
+    unsigned long long int key;
+    // everything but the board which can change the solution
+    unsigned long long int settings;
+    unsigned long long int blocked;
+    // the clock of the last hit
+    unsigned long long int used;
+    unsigned char board[MAX_BOARD_LENGTH / 2];
+    unsigned char final_board[MAX_BOARD_LENGTH / 2];
+    unsigned short steps;
+    unsigned char begin;
+    unsigned char combo;
+    unsigned char max_combo;
+    unsigned char colour;
+    unsigned char success;
+    unsigned char reserved;
+    unsigned char route[CACHE_ROUTE_BYTES];
+};
+
+// Solutions of boards seen before, kept in a file so they survive restarts.
+// The table has a fixed number of entries split into sets of CACHE_WAYS, a
+// board can only be in the set its key picks. It can be shared by threads
+// but not by processes, the file is locked while it is open
+class solution_cache {
+    struct header;
+
+    unsigned char* DATA = nullptr;
+    size_t LENGTH = 0;
+    header* HEADER = nullptr;
+    cache_entry* ENTRIES = nullptr;
+    int SETS = 0;
+    int SIZE = 0;
+    long long int HITS = 0;
+    long long int MISSES = 0;
+    long long int EVICTIONS = 0;
+    std::string PATH;
+    std::string ERROR;
+    // only used without mmap or without a file
+    std::vector<unsigned char> BUFFER;
+    // kept open for the exclusive lock on the mapped file
+    int LOCK_FD = -1;
+    mutable std::mutex MUTEX;
+
+    bool map(int);
+
+public:
+    solution_cache() = default;
+    ~solution_cache() { close(); }
+    solution_cache(const solution_cache&) = delete;
+    solution_cache& operator=(const solution_cache&) = delete;
+
+    // an existing file keeps its capacity, a new one or one which isn't a
+    // cache gets the given number of entries. Empty keeps it in memory
+    bool open(const std::string&, int);
+    void close();
+
+    bool find(const canonical_board&, unsigned long long int, cached_solution&);
+    // solutions with routes too long for an entry aren't kept
+    void store(const canonical_board&, unsigned long long int, const cached_solution&);
+
+    const std::string& error() const { return ERROR; }
+    int capacity() const { return SETS * CACHE_WAYS; }
+    int size() const;
+    long long int hits() const;
+    long long int misses() const;
+    long long int evictions() const;
+};
+
+}  // namespace pazusoba
+
+#endif
@@ -9,8 +9,19 @@
 #ifndef _CORE_H_
 #define _CORE_H_
 
+#include "async.h"
+#include "batch.h"
+#include "bits.h"
+#include "bulk.h"
+#include "cache.h"
+#include "corpus.h"
+#include "daemon.h"
+#include "evaluate.h"
 #include "hash.h"
+#include "metrics.h"
 #include "pazusoba.h"
+#include "route.h"
+#include "service.h"
 #include "shape.h"
 #include "timer.h"
 
@@ -0,0 +1,138 @@
+#pragma once
+#ifndef _PAZUSOBA_CORPUS_H_
+#define _PAZUSOBA_CORPUS_H_
+
+#include "pazusoba.h"
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace pazusoba {
+
+// Binary board corpus, every number is little endian
+//   header, 32 bytes
+//     "PZBC", version, flags, rows, columns, count (4), record size (4)
+//   records, all the same size so they can be indexed
+//     orbs packed 4 bits each with the lower half first
+//     blocked cells as a 64 bit mask if corpus_blocked is set
+//     the expected combo as one byte if corpus_expected_combo is set
+#define CORPUS_HEADER_SIZE 32
+#define CORPUS_VERSION 1
+
+enum corpus_flags {
+    corpus_blocked = 1,
+    corpus_expected_combo = 2,
+};
+
+// A record inside the corpus, nothing is copied until it is unpacked
+class corpus_record {
+    const unsigned char* DATA = nullptr;
+    int SIZE = 0;
+    int FLAGS = 0;
+
+public:
+    corpus_record() = default;
+    corpus_record(const unsigned char* data, int size, int flags)
+        : DATA(data), SIZE(size), FLAGS(flags) {}
+
+    int size() const { return SIZE; }
+    orb at(int i) const { return (DATA[i / 2] >> (i % 2 * 4)) & 0xf; }
+    // orbs are copied as they are, a corrupt file can have any up to 15
+    void unpack(game_board&) const;
+    // ORB_WEB_NAME letters, the buffer needs size() + 1 chars. Unknown orbs
+    // are '?' so the board is rejected like a bad text line
+    void board_string(char*) const;
+    std::string board() const;
+    unsigned long long int blocked_mask() const;
+    // -1 if the corpus has no expected combos
+    int expected_combo() const;
+};
+
+// Map a corpus file and read its records in place
+class corpus_reader {
+    const unsigned char* DATA = nullptr;
+    size_t LENGTH = 0;
+    int ROWS = 0;
+    int COLUMNS = 0;
+    int COUNT = 0;
+    int FLAGS = 0;
+    int RECORD_SIZE = 0;
+    std::string ERROR;
+    // only used where mmap isn't available
+    std::vector<unsigned char> BUFFER;
+
+public:
+    class iterator {
+        const corpus_reader* READER;
+        int INDEX;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef corpus_record value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const corpus_record* pointer;
+        typedef corpus_record reference;
+
+        iterator(const corpus_reader* reader, int index) : READER(reader), INDEX(index) {}
+        corpus_record operator*() const { return (*READER)[INDEX]; }
+        iterator& operator++() {
+            INDEX++;
+            return *this;
+        }
+        bool operator!=(const iterator& other) const { return INDEX != other.INDEX; }
+        bool operator==(const iterator& other) const { return INDEX == other.INDEX; }
+    };
+
+    corpus_reader() = default;
+    ~corpus_reader() { close(); }
+    corpus_reader(const corpus_reader&) = delete;
+    corpus_reader& operator=(const corpus_reader&) = delete;
+
+    // false with error() set if the file isn't a corpus
+    bool open(const std::string&);
+    // records can't be used after closing
+    void close();
+
+    const std::string& error() const { return ERROR; }
+    int rows() const { return ROWS; }
+    int columns() const { return COLUMNS; }
+    int count() const { return COUNT; }
+    int flags() const { return FLAGS; }
+    corpus_record operator[](int i) const {
+        return corpus_record(DATA + CORPUS_HEADER_SIZE + (size_t)i * RECORD_SIZE,
+                             ROWS * COLUMNS, FLAGS);
+    }
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, COUNT); }
+};
+
+// Append boards of the same size to a new corpus
+class corpus_writer {
+    FILE* FILE_HANDLE = nullptr;
+    int ROWS = 0;
+    int COLUMNS = 0;
+    int COUNT = 0;
+    int FLAGS = 0;
+    std::string ERROR;
+
+public:
+    corpus_writer() = default;
+    ~corpus_writer() { close(); }
+    corpus_writer(const corpus_writer&) = delete;
+    corpus_writer& operator=(const corpus_writer&) = delete;
+
+    bool open(const std::string&, int, int, int);
+    // the blocked mask and the expected combo are ignored unless the flags
+    // ask for them, -1 means the combo is unknown
+    bool add(const std::string&, unsigned long long int = 0, int = -1);
+    // the count in the header is written here
+    bool close();
+
+    const std::string& error() const { return ERROR; }
+    int count() const { return COUNT; }
+};
+
+}  // namespace pazusoba
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef _PAZUSOBA_DAEMON_H_
+#define _PAZUSOBA_DAEMON_H_
+
+#include "metrics.h"
+#include "service.h"
+#include <string>
+
+namespace pazusoba {
+
+struct daemon_options {
+    // a unix socket to listen on, stdin and stdout are used if it is empty
+    std::string socket_path;
+    // requests solved at the same time, they share the threads
+    int workers = 1;
+    // 0 uses one for each processor
+    int threads = 0;
+    // serve Prometheus metrics over HTTP on this localhost port, or on this
+    // unix socket if it isn't a number. SIGUSR1 dumps them to stderr anyway
+    std::string metrics;
+    // keep solutions in this file so repeated boards skip the search, see
+    // cache.h. Empty turns it off
+    std::string cache;
+    int cache_size = 16384;
+};
+
+// Read requests line by line and answer with one line each, see service.h.
+// Requests without an id get their line number on the connection, answers
+// may come back in a different order with more than one worker. Returns
+// the exit code once stdin ends or the process is interrupted
+int run_daemon(const daemon_options&);
+
+}  // namespace pazusoba
+
+#endif
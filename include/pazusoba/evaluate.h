@@ -0,0 +1,50 @@
+#pragma once
+#ifndef _PAZUSOBA_EVALUATE_H_
+#define _PAZUSOBA_EVALUATE_H_
+
+#include "pazusoba.h"
+
+namespace pazusoba {
+
+// Profiles to score a board for, the same as a solver would use
+struct evaluation_plan {
+    const profile* profiles = nullptr;
+    int count = 0;
+    // targets checked against the board, see solver::verdicts(). Without
+    // them the targets of the profiles are used and every profile is a goal
+    const profile_verdict* verdicts = nullptr;
+    int goal_count = 0;
+    // steps of the route, shorter routes score a little more
+    int step = 0;
+    // the goal of max combo profiles, see solver::max_combo(). 0 estimates
+    // it from the board which needs a packing search and allocates
+    int max_combo = 0;
+};
+
+// What erasing a board does, orbs don't fall in from outside
+struct board_evaluation {
+    int combo = 0;
+    // combos and erased orbs of each colour
+    int colour_combo[ORB_COUNT]{0};
+    int erased[ORB_COUNT]{0};
+    // passes which erased something, more than one means orbs fell into
+    // new combos
+    int rounds = 0;
+    int remaining = 0;
+    int score = 0;
+    bool goal = false;
+    game_board board{0};
+};
+
+// Erase the board and score it without a solver, nothing is shared so it
+// can be called from any thread. Boards must have one of the supported
+// sizes and orbs must be below ORB_COUNT, unknown profiles are ignored
+board_evaluation evaluate_board(const game_board&,
+                                int,
+                                int,
+                                int,
+                                const evaluation_plan* = nullptr);
+
+}  // namespace pazusoba
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef _PAZUSOBA_METRICS_H_
+#define _PAZUSOBA_METRICS_H_
+
+#include "service.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace pazusoba {
+
+// Log linear buckets like HDR histograms, every power of two of
+// microseconds is split into a few linear buckets. Counts are atomic so
+// recording never takes a lock
+class latency_histogram {
+public:
+    static const int SUB_BUCKETS = 4;
+    // 128 us to 33 s, slower ones are only in the count and the sum
+    static const int MIN_SHIFT = 7;
+    static const int MAX_SHIFT = 25;
+    static const int BUCKET_COUNT = (MAX_SHIFT - MIN_SHIFT) * SUB_BUCKETS + 1;
+
+    void record(long long int);
+    // the largest latency in microseconds counted by the bucket
+    static long long int bound(int);
+    long long int bucket(int i) const { return BUCKETS[i].load(std::memory_order_relaxed); }
+    long long int count() const { return COUNT.load(std::memory_order_relaxed); }
+    long long int sum() const { return SUM.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<long long int> BUCKETS[BUCKET_COUNT]{};
+    std::atomic<long long int> COUNT{0};
+    std::atomic<long long int> SUM{0};
+};
+
+// Counters of a long running solver, shared by every thread of the daemon
+class daemon_metrics {
+    // 4x5, 5x6 and 6x7 boards
+    static const int SIZE_COUNT = 3;
+
+    std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+    std::atomic<long long int> REQUESTS{0};
+    std::atomic<long long int> REJECTED{0};
+    std::atomic<long long int> SOLVED{0};
+    std::atomic<long long int> TIMEOUTS{0};
+    std::atomic<long long int> CACHE_HITS{0};
+    std::atomic<int> QUEUED{0};
+    // in millionths to stay an integer
+    std::atomic<long long int> OCCUPANCY{0};
+    std::atomic<long long int> VISITED{0};
+    std::atomic<long long int> DUPLICATES{0};
+    latency_histogram LATENCY[SIZE_COUNT];
+
+public:
+    void received() { REQUESTS++; }
+    void rejected() { REJECTED++; }
+    void queued() { QUEUED++; }
+    void dequeued() { QUEUED--; }
+    void solved(const solve_request&, const solve_response&);
+    // Prometheus text format
+    std::string text() const;
+};
+
+}  // namespace pazusoba
+
+#endif
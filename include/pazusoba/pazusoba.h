@@ -3,8 +3,14 @@
 #define _PAZUSOBA_H_
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -17,8 +23,12 @@ namespace pazusoba {
 
 #define MAX_DEPTH 150
 #define MIN_BEAM_SIZE 100
+// the beam is kept 1.4 times over for every child, larger ones run out of memory
+#define MAX_BEAM_SIZE 100000
 #define MAX_BOARD_LENGTH 42
 #define MIN_STATE_SCORE -9999
+// states a search thread expands before checking if it is cancelled
+#define PROGRESS_CHUNK 256
 
 #define ROUTE_PER_LIST 21
 #define ROUTE_MASK 0x7000000000000000
@@ -100,6 +110,17 @@ struct profile {
     bool orbs[ORB_COUNT]{false};
 };
 
+// What the board can do for a profile, checked before searching
+struct profile_verdict {
+    // the goal can be reached with the orbs on the board
+    bool feasible = true;
+    // the goal can't be reached but the closest one is searched instead
+    bool relaxed = false;
+    // targets used by the search, same as the profile unless relaxed
+    int target = -1;
+    int colour_target = 0;
+};
+
 // this helps to calculate the distance between a kind of orb
 struct orb_distance {
     int min = 0;
@@ -114,6 +135,107 @@ struct combo {
 };
 typedef std::vector<combo> combo_list;
 
+// count / min_erase summed over all colours, no arrangement without
+// cascading goes past it
+int count_max_combo(const orb_list&, const int);
+// The most combos the orbs can be arranged into without cascading. Only
+// rectangle combos are packed so it is exact only if it equals
+// count_max_combo(), otherwise a better arrangement might be missed. 0 means
+// unknown and an upper bound is returned when the packing search gives up
+int pack_max_combo(const orb_list&, const int, const int, const int);
+// The packed max combo of a board with the given rows and columns, a naive
+// estimate is used if no packing can be found. The max combo goal is only
+// reached when this equals count_max_combo(), otherwise it is a reference
+// and the search goes on for the best score
+int estimate_max_combo(const orb_list&, const int, const int, const int);
+
+// direction of a step in a route with the given steps
+int route_direction(const route_list&, const int, const int);
+// directions of a route with the given steps, the first step comes first
+std::vector<int> decode_route(const route_list&, const int);
+
+// What a running search has done so far
+struct progress {
+    int depth = 0;
+    int best_score = MIN_STATE_SCORE;
+    int best_combo = 0;
+    long long int expanded = 0;
+    bool cancelled = false;
+    // cancelled because the deadline passed
+    bool timed_out = false;
+    bool finished = false;
+};
+
+// Shared with a running adventure(), it can be used from any thread without
+// locking. Cancelling is checked by the search threads between chunks
+class search_progress {
+    // depth, best combo and best score are packed to be read together
+    std::atomic<long long int> BEST{0};
+    std::atomic<long long int> EXPANDED{0};
+    std::atomic<bool> CANCELLED{false};
+    std::atomic<bool> TIMED_OUT{false};
+    std::atomic<bool> FINISHED{false};
+    // steady clock ticks, 0 means no deadline
+    std::atomic<long long int> DEADLINE{0};
+
+public:
+    search_progress() { reset(); }
+    search_progress(const search_progress&) = delete;
+    search_progress& operator=(const search_progress&) = delete;
+
+    // everything except cancelled, a search can be cancelled before it starts
+    void reset();
+    void publish(const int, const int, const int);
+    void add_expanded(const long long int);
+    void finish();
+    void cancel();
+    // cancel the search once the time point has passed
+    void set_deadline(const std::chrono::steady_clock::time_point&);
+    // the deadline is checked here as well
+    bool cancelled();
+    progress snapshot() const;
+};
+
+// Threads started once and reused by every depth of every search
+class worker_pool {
+    std::vector<std::thread> THREADS;
+    std::mutex MUTEX;
+    std::condition_variable WAKE;
+    std::condition_variable DONE;
+    std::function<void(int)> TASK;
+    int TASK_COUNT = 0;
+    int RUNNING = 0;
+    int GENERATION = 0;
+    bool STOP = false;
+
+    void work(const int);
+
+public:
+    worker_pool() = default;
+    ~worker_pool();
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+
+    // call the task with 0 to count - 1, 0 runs on the calling thread and
+    // the call blocks until every task is done
+    void run(const int, const std::function<void(int)>&);
+    int size() const { return THREADS.size() + 1; }
+};
+
+// one thread for each processor, at least 1
+int default_thread_count();
+
+class canonical_board;
+class solution_cache;
+
+// Buffers and threads kept between searches, it can't be shared by two
+// searches running at the same time
+struct workspace {
+    worker_pool pool;
+    std::vector<state> look;
+    std::vector<state> temp;
+};
+
 class solver {
     ///
     /// class variables, they shouldn't be changed outside parse_args()
@@ -124,14 +246,46 @@ class solver {
     bool ALLOW_DIAGONAL = false;
     int ROW, COLUMN;
     int MAX_COMBO;
-    int BOARD_SIZE;
+    int BOARD_SIZE = 0;
     int STOP_THRESHOLD = 20;
+    // skip states that can no longer beat the best state
+    bool PRUNING = true;
+    int PRUNED_COUNT = 0;
+    // states checked against VISITED and how many of them were seen before
+    int VISITED_COUNT = 0;
+    int DUPLICATE_COUNT = 0;
+    // search the last steps of the best states again, 0 turns it off
+    int REFINE_DEPTH = 0;
+    int REFINE_CANDIDATES = 8;
+    // in milliseconds, shared by all candidates
+    int REFINE_TIME = 200;
+    // look for a shorter route with the same result after searching
+    bool SHORTEN = false;
+    int SAVED_STEPS = 0;
+    // commit the route prefix this share of the beam agrees on, 0 turns it off
+    double COMMIT_RATIO = 0;
+    // the start is decided, COMMITTED holds the prefix and the board after it
+    bool COMMITTED_START = false;
+    state COMMITTED;
+    std::function<void(const state&)> COMMIT_CALLBACK;
+    // not owned, adventure() reports to it and stops if it is cancelled
+    search_progress* PROGRESS = nullptr;
+    // search threads, 0 uses one for each processor
+    int THREAD_COUNT = 0;
+    // not owned, adventure() uses a workspace of its own without it
+    workspace* WORKSPACE = nullptr;
+    // not owned, adventure() answers boards it has seen from it
+    solution_cache* CACHE = nullptr;
+    bool CACHE_HIT = false;
     profile* PROFILES;
     int PROFILE_COUNT = 0;
+    // one for each profile, updated whenever the board or profiles change
+    std::vector<profile_verdict> VERDICTS;
+    // profiles whose goal can still be reached, possibly relaxed
+    int GOAL_COUNT = 0;
 
     game_board BOARD;
-    // count the number of each orb to calculate the max combo (not 100%
-    // correct)
+    // count the number of each orb to calculate the max combo
     std::array<orb, ORB_COUNT> ORB_COUNTER;
     std::unordered_set<long long int> VISITED;
     std::array<bool, MAX_BOARD_LENGTH> BLOCKED{};
@@ -157,8 +311,43 @@ public:
     void check_3x3_squares(game_board&, combo_list&, visit_board&);
     bool is_3x3_square(const std::unordered_set<int>&, int) const;
     void move_orbs_down(game_board&);
-    // A naive way to approach max combo, mostly accurate unless 2 colours
-    int calc_max_combo(const orb_list&, const int, const int) const;
+    // Pack combos into the board to find the max combo, the naive estimate
+    // is only used if no packing can be found
+    int calc_max_combo(const orb_list&, const int) const;
+    // optimistic combo count for every descendant of a board with the finger
+    // at the given location and the remaining steps, per colour combos are
+    // written to the list
+    int combo_upper_bound(const game_board&,
+                          const int,
+                          const int,
+                          int*) const;
+    // true when no descendant of the state can beat the best score or reach
+    // the goal, only target_combo profiles can be bounded
+    bool can_prune(const state&, const int) const;
+    // try every route for the last steps of each candidate and keep the best
+    // state, candidates are refined in parallel until the time is up
+    state refine(const std::vector<state>&);
+    // re-root the state refine depth steps earlier and search exhaustively
+    state refine_tail(const state&,
+                      const std::chrono::steady_clock::time_point&);
+    // the same or an equivalent board with a shorter route, see route.h
+    state shorten(const state&);
+    // extend the committed prefix if enough states agree on it and drop the
+    // ones which don't follow it, true if the prefix grows
+    bool commit_prefix(std::vector<state>&);
+    bool follows_commit(const state&) const;
+    // move the finger one step and update the route, it isn't evaluated
+    void move(state&, const int) const;
+    // everything except the board which can change the result of a search
+    unsigned long long int cache_settings() const;
+    // the board with the colours no profile asks for relabelled, see cache.h
+    canonical_board canonical() const;
+    // replay a cached route on the board, false if it isn't cached
+    bool load_cached(state&);
+    void store_cached(const state&);
+    // check every profile against the orb counts of the board, impossible
+    // goals are relaxed to the closest reachable one if there is any
+    void check_profiles();
 
     void parse_args(int argc, char* argv[]);
     // set board from string, setup row and column, calculate max combo and
@@ -170,11 +359,25 @@ public:
     void set_diagonal(bool);
     void set_profiles(profile*, int);
     void set_blocked(const int*, int);
+    void set_pruning(bool);
+    // depth, candidates and time limit in milliseconds
+    void set_refine(int, int, int);
+    void set_shorten(bool);
+    void set_commit(double);
+    // called from adventure() whenever the committed prefix grows
+    void set_commit_callback(std::function<void(const state&)>);
+    void set_progress(search_progress*);
+    // keep buffers and threads warm when solving many boards in a row
+    void set_workspace(workspace*);
+    void set_threads(int);
+    // share solutions of boards seen before, see cache.h
+    void set_cache(solution_cache*);
 
     void print_board(const game_board&) const;
     void print_state(const state&) const;
     void print_route(const route_list&, const int, const int) const;
     std::string get_board_string(const game_board&) const;
+    std::string get_route_string(const state&) const;
     void usage() const;
 
     // getters
@@ -188,6 +391,25 @@ public:
     const game_board& board() const { return BOARD; }
     const std::array<bool, MAX_BOARD_LENGTH>& blocked() const { return BLOCKED; }
     bool diagonal() const { return ALLOW_DIAGONAL; }
+    bool pruning() const { return PRUNING; }
+    int pruned_count() const { return PRUNED_COUNT; }
+    int visited_count() const { return VISITED_COUNT; }
+    int duplicate_count() const { return DUPLICATE_COUNT; }
+    // the last adventure() was answered by the cache
+    bool cached() const { return CACHE_HIT; }
+    int refine_depth() const { return REFINE_DEPTH; }
+    // the number of threads a search uses
+    int thread_count() const;
+    // the count given to set_threads(), 0 uses one for each processor
+    int threads() const { return THREAD_COUNT; }
+    workspace* current_workspace() const { return WORKSPACE; }
+    bool shortening() const { return SHORTEN; }
+    int saved_steps() const { return SAVED_STEPS; }
+    double commit_ratio() const { return COMMIT_RATIO; }
+    const state& committed() const { return COMMITTED; }
+    const std::vector<profile_verdict>& verdicts() const { return VERDICTS; }
+    // false if no profile can be fulfilled, adventure() won't search at all
+    bool feasible() const { return PROFILE_COUNT == 0 || GOAL_COUNT > 0; }
 };
 }  // namespace pazusoba
 
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef _PAZUSOBA_ROUTE_H_
+#define _PAZUSOBA_ROUTE_H_
+
+#include "pazusoba.h"
+#include <array>
+#include <string>
+
+namespace pazusoba {
+
+struct route_options {
+    bool allow_diagonal = false;
+    // the longest part of a route searched again at once, it costs about
+    // 3^(window / 2) boards for every pair of steps
+    int window = 12;
+    // also accept a final board which erases the same combos
+    bool same_combo = false;
+    int min_erase = 3;
+};
+
+struct shortened_route {
+    int start = -1;
+    int steps = 0;
+    // how many steps are removed from the original route
+    int saved = 0;
+    std::string route;
+    std::string final_board;
+};
+
+// Search for a shorter route from the same start, routes use DIRECTION_NAME
+shortened_route shorten_route(const std::string& board,
+                              int rows,
+                              int cols,
+                              int start,
+                              const std::string& route,
+                              const route_options& options);
+
+shortened_route shorten_route(const std::string& board,
+                              int rows,
+                              int cols,
+                              int start,
+                              const std::string& route,
+                              const route_options& options,
+                              const std::array<bool, MAX_BOARD_LENGTH>& blocked);
+
+}  // namespace pazusoba
+
+#endif
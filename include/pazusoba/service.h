@@ -0,0 +1,79 @@
+#pragma once
+#ifndef _PAZUSOBA_SERVICE_H_
+#define _PAZUSOBA_SERVICE_H_
+
+#include "pazusoba.h"
+#include <string>
+#include <vector>
+
+namespace pazusoba {
+
+// One line of the text protocol, only the board is required
+//   board [id=text] [erase=3] [depth=100] [beam=10000] [diagonal=1]
+//         [blocked=0,7,14] [deadline=ms] [profile=name[:target[:orbs]]]...
+// erase is 3 to 5, depth 1 to MAX_DEPTH and beam 1 to MAX_BEAM_SIZE, other
+// values are rejected instead of being clamped by the solver
+// profile names are combo, colour, colour_combo, connected, remaining,
+// L, plus, square, row and column, orbs are given as RBGLDH...
+struct solve_request {
+    std::string id;
+    std::string board;
+    int min_erase = 3;
+    int search_depth = 100;
+    int beam_size = 10000;
+    bool diagonal = false;
+    std::vector<int> blocked;
+    // in milliseconds, 0 means no deadline
+    int deadline = 0;
+    // target_combo is used if there is none
+    std::vector<profile> profiles;
+};
+
+// One result line, either
+//   ok id=text start=12 route=LLDR combo=7 max=8 steps=4 score=2053 goal=0
+//      timeout=0 cached=0 ms=12.3
+//   error id=text reason
+struct solve_response {
+    std::string id;
+    bool ok = false;
+    std::string error;
+    int start = -1;
+    std::string route;
+    int combo = 0;
+    int max_combo = 0;
+    int steps = 0;
+    int score = MIN_STATE_SCORE;
+    bool goal = false;
+    bool timed_out = false;
+    // answered by the solution cache without searching
+    bool cached = false;
+    double ms = 0;
+    // how far the search went
+    int depth = 0;
+    long long int expanded = 0;
+    int visited = 0;
+    int duplicates = 0;
+};
+
+// Fill the request from the line, fields the line leaves out keep their
+// values. False with the reason if the line can't be solved
+bool parse_request(const std::string&, solve_request&, std::string&);
+// Same as parse_request() without a board, for defaults of many requests
+bool parse_options(const std::string&, solve_request&, std::string&);
+// The checks of parse_request() on the board and blocked cells, for
+// requests which don't come from a line
+bool validate_request(const solve_request&, std::string&);
+
+// Solve with a fresh solver so earlier requests can't change the result,
+// the workspace keeps buffers and threads warm. 0 threads uses them all,
+// the cache is optional
+solve_response solve_request_with(const solve_request&,
+                                  workspace&,
+                                  int,
+                                  solution_cache* = nullptr);
+
+std::string format_response(const solve_response&);
+
+}  // namespace pazusoba
+
+#endif
@@ -16,6 +16,18 @@ enum shape_kind {
     shape_full_column,
 };
 
+// How the route to a placement is found
+enum shape_search {
+    // move the orbs in one at a time with small searches, fast but long
+    shape_constructive = 0,
+    // weighted A* over the cells of the colour and the finger, shorter
+    // routes but it can give up on hard boards
+    shape_astar,
+    // the same heuristic searched depth first with a rising bound, slower
+    // than A* but the memory is fixed by table_entries
+    shape_ida,
+};
+
 enum color_mode {
     color_auto = 0,
     color_only,
@@ -28,6 +40,22 @@ struct shape_request {
     bool colors[ORB_COUNT]{false};
     bool strict_isolation = false;
     bool allow_diagonal = false;
+    // stop at the first route found instead of the one with the most combos
+    bool first_feasible = false;
+    // candidates are tried by this many threads, 0 is one per processor
+    int threads = 0;
+    // constructive only, orbs are moved by searching from the board and
+    // back from the goal at once. Routes are as short but may differ
+    bool bidirectional = false;
+    int search = shape_constructive;
+    // A* and IDA*, routes are at most this long and a colour is given up
+    // after expanding this many states. A weight above 1 trades length for
+    // speed
+    double weight = 4.0;
+    int max_steps = 80;
+    int node_limit = 500000;
+    // IDA* only, states remembered by all threads together, 16 bytes each
+    int table_entries = 1 << 20;
 };
 
 struct shape_result {
@@ -50,6 +78,35 @@ struct shape_template {
 
 shape_template make_shape_template(int kind);
 
+// A placement of a shape, cells are bits of the board in the mask
+struct shape_placement {
+    unsigned long long int mask = 0;
+    // cells next to the shape but not in it, without diagonals
+    unsigned long long int border = 0;
+    std::vector<int> cells;
+};
+
+// Placements from shape_template::placements() worked out once for every
+// kind and board size, the table is kept for the whole process
+const std::vector<shape_placement>& shape_placements(int kind, int rows, int cols);
+
+// Fewest moves to bring the orb on one cell to another with the finger
+// starting on a third. Orbs only move when the finger steps onto them so
+// this counts the moves to get behind the orb which distances miss, the
+// finger starting on the orb holds it. Blocked cells are left out so it
+// never costs more than the board
+struct shape_pattern {
+    int size = 0;
+    std::vector<unsigned char> steps;
+
+    int operator()(int finger, int orb, int target) const {
+        return steps[(target * size + orb) * size + finger];
+    }
+};
+
+// Worked out once for every board size and diagonal setting
+const shape_pattern& shape_patterns(int rows, int cols, bool diagonal);
+
 bool board_has_shape(const std::string& board,
                      int rows,
                      int cols,
@@ -67,6 +124,17 @@ shape_result solve_shape(const std::string& board,
                          const shape_request& request,
                          const std::array<bool, MAX_BOARD_LENGTH>& blocked);
 
+class solution_cache;
+
+// The same as above, boards the cache has seen are answered from it and new
+// ones are added. Colours are only swapped if the request doesn't pick any
+shape_result solve_shape(const std::string& board,
+                         int rows,
+                         int cols,
+                         const shape_request& request,
+                         const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                         solution_cache* cache);
+
 }  // namespace pazusoba
 
 #endif
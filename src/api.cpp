@@ -1,32 +1,19 @@
+#include <pazusoba/api.h>
 #include <pazusoba/core.h>
+#include <algorithm>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 extern "C" {
-// Holds the row & column of where to go next
-struct c_location {
-    int row = -1;
-    int column = -1;
-};
-
-// C interface of pazusoba::state
-struct c_state {
-    int combo;
-    int max_combo;
-    int step;
-    int row;
-    int column;
-    bool goal;
-    // add the first step here as well
-    c_location routes[MAX_DEPTH + 1];
-    // TODO: this should be a c type not std::array but it works
-    pazusoba::game_board board;
-};
 
-c_state convert(const pazusoba::solver& solver, const pazusoba::state& state) {
+// Write the state into a caller owned c_state
+void convert_into(const pazusoba::solver& solver,
+                  const pazusoba::state& state,
+                  c_state& c_state) {
     int column = solver.column();
     int step = state.step;
 
-    c_state c_state;
     c_state.combo = state.combo;
     c_state.max_combo = solver.max_combo();
     c_state.step = state.step;
@@ -81,7 +68,14 @@ c_state convert(const pazusoba::solver& solver, const pazusoba::state& state) {
         }
         index++;
     }
+    // the buffer may hold a longer route from the last solve
+    for (int i = count + 1; i <= MAX_DEPTH; i++)
+        c_state.routes[i] = c_location();
+}
 
+c_state convert(const pazusoba::solver& solver, const pazusoba::state& state) {
+    c_state c_state;
+    convert_into(solver, state, c_state);
     return c_state;
 }
 
@@ -101,6 +95,341 @@ c_state adventureEx(const char* board,
     return convert(solver, state);
 }
 
+// A solver kept between solves, its beam buffers, visited set and threads
+// are reused instead of being set up for every board
+struct c_solver {
+    pazusoba::solver solver;
+    pazusoba::workspace space;
+    std::vector<pazusoba::profile> profiles;
+    // why the last board was rejected
+    std::string error;
+};
+
+// set_board() exits on a bad board, every entry point checks it first so a
+// caller of the library gets an error instead
+bool valid_board(const char* board, std::string& error) {
+    pazusoba::solve_request request;
+    request.board = board == nullptr ? "" : board;
+    return pazusoba::validate_request(request, error);
+}
+
+bool accept_board(c_solver& kept, const char* board) {
+    if (!valid_board(board, kept.error))
+        return false;
+    kept.error.clear();
+    kept.solver.set_board(board);
+    return true;
+}
+
+void* solverCreate() {
+    auto handle = new c_solver();
+    handle->solver.set_workspace(&handle->space);
+    return handle;
+}
+
+// Replace every setting, profiles are copied into the handle
+void solverConfigure(void* handle,
+                     int min_erase,
+                     int search_depth,
+                     int beam_size,
+                     pazusoba::profile* profiles,
+                     int count) {
+    auto kept = static_cast<c_solver*>(handle);
+    kept->profiles.assign(profiles, profiles + count);
+    auto& solver = kept->solver;
+    solver = pazusoba::solver();
+    solver.set_workspace(&kept->space);
+    solver.set_min_erase(min_erase);
+    solver.set_search_depth(search_depth);
+    solver.set_beam_size(beam_size);
+    solver.set_profiles(kept->profiles.data(), count);
+}
+
+// Solve the board with the current settings and write the best state into
+// the given buffer. False if the board is rejected, see solverError()
+bool solverSolve(void* handle, const char* board, c_state* result) {
+    auto& kept = *static_cast<c_solver*>(handle);
+    if (!accept_board(kept, board))
+        return false;
+    auto state = kept.solver.adventure();
+    convert_into(kept.solver, state, *result);
+    return true;
+}
+
+void compact_into(pazusoba::solver& solver,
+                  const pazusoba::state& state,
+                  bool segments,
+                  bool colour_combo,
+                  c_compact_state& compact) {
+    int step = state.step;
+    compact.combo = state.combo;
+    compact.max_combo = solver.max_combo();
+    compact.step = step;
+    compact.row = solver.row();
+    compact.column = solver.column();
+    compact.goal = state.goal;
+    compact.rejected = false;
+    compact.start = step > 0 ? state.begin : -1;
+    std::copy(state.board.begin(), state.board.end(), compact.board);
+    for (int i = 0; i < step; i++)
+        compact.directions[i] = pazusoba::route_direction(state.route, step, i);
+
+    compact.segment_count = 0;
+    if (segments) {
+        for (int i = 0; i < step; i++) {
+            int last = compact.segment_count - 1;
+            if (last >= 0 && compact.segment_directions[last] == compact.directions[i]) {
+                compact.segment_lengths[last]++;
+                continue;
+            }
+            compact.segment_directions[compact.segment_count] = compact.directions[i];
+            compact.segment_lengths[compact.segment_count] = 1;
+            compact.segment_count++;
+        }
+    }
+
+    std::fill(compact.colour_combo, compact.colour_combo + ORB_COUNT, 0);
+    if (colour_combo && step > 0) {
+        // erase the board again, the state only keeps the total
+        const int MAX_ELIMINATION_ROUNDS = 20;
+        pazusoba::game_board copy = state.board;
+        for (int round = 0; round < MAX_ELIMINATION_ROUNDS; round++) {
+            pazusoba::combo_list list;
+            solver.erase_combo(copy, list);
+            if (list.empty())
+                break;
+            for (const auto& c : list)
+                compact.colour_combo[c.info]++;
+            solver.move_orbs_down(copy);
+        }
+    }
+}
+
+// Same as solverSolve() but the result is written in the compact form,
+// straight segments and combos by colour are optional
+bool solverSolveCompact(void* handle,
+                        const char* board,
+                        bool segments,
+                        bool colour_combo,
+                        c_compact_state* result) {
+    auto& kept = *static_cast<c_solver*>(handle);
+    if (!accept_board(kept, board))
+        return false;
+    auto state = kept.solver.adventure();
+    compact_into(kept.solver, state, segments, colour_combo, *result);
+    return true;
+}
+
+// Empty unless the last board was rejected, it lives as long as the handle
+const char* solverError(void* handle) {
+    return static_cast<c_solver*>(handle)->error.c_str();
+}
+
+void solverFree(void* handle) {
+    delete static_cast<c_solver*>(handle);
+}
+
+// Solve every job over the same threads, results are written in the order
+// of the jobs, straight segments and combos by colour are always filled.
+// A job with a bad board is rejected with step -1 and isn't searched
+void adventureBatch(const c_job* jobs,
+                    int count,
+                    int threads,
+                    c_compact_state* results,
+                    c_batch_callback callback) {
+    // jobs with a bad board are skipped, the rest keep running
+    std::vector<pazusoba::solver> solvers;
+    std::vector<int> job_of;
+    std::string error;
+    for (int i = 0; i < count; i++) {
+        if (!valid_board(jobs[i].board, error)) {
+            results[i] = c_compact_state();
+            results[i].step = -1;
+            results[i].start = -1;
+            results[i].rejected = true;
+            if (callback)
+                callback(i, &results[i]);
+            continue;
+        }
+        pazusoba::solver solver;
+        solver.set_board(jobs[i].board);
+        solver.set_min_erase(jobs[i].min_erase);
+        solver.set_search_depth(jobs[i].search_depth);
+        solver.set_beam_size(jobs[i].beam_size);
+        solver.set_profiles(jobs[i].profiles, jobs[i].count);
+        solvers.push_back(solver);
+        job_of.push_back(i);
+    }
+
+    pazusoba::batch_options options;
+    options.threads = threads;
+    // a job is encoded as soon as it is done, it can't be touched again
+    options.on_result = [&](int index, const pazusoba::state& state) {
+        auto& result = results[job_of[index]];
+        compact_into(solvers[index], state, true, true, result);
+        if (callback)
+            callback(job_of[index], &result);
+    };
+    pazusoba::solve_batch(solvers, options);
+}
+
+// Same as adventureEx() but the route prefix the given share of the beam
+// agrees on is decided early and passed to the callback
+c_state adventureCommitEx(const char* board,
+                          int min_erase,
+                          int search_depth,
+                          int beam_size,
+                          pazusoba::profile* profiles,
+                          int count,
+                          double ratio,
+                          c_commit_callback callback) {
+    std::string error;
+    if (!valid_board(board, error)) {
+        // an empty state, nothing moved and nothing to compare with
+        auto empty = c_state();
+        empty.combo = -1;
+        empty.step = 0;
+        return empty;
+    }
+    auto solver = pazusoba::solver();
+    solver.set_board(board);
+    solver.set_min_erase(min_erase);
+    solver.set_search_depth(search_depth);
+    solver.set_beam_size(beam_size);
+    solver.set_profiles(profiles, count);
+    solver.set_commit(ratio);
+    if (callback) {
+        solver.set_commit_callback([&solver, callback](const pazusoba::state& prefix) {
+            auto c_prefix = convert(solver, prefix);
+            callback(&c_prefix);
+        });
+    }
+    auto state = solver.adventure();
+    return convert(solver, state);
+}
+
+// Check profiles against the board without searching, verdicts must hold
+// count items. Returns how many profiles are feasible as they are, -1 if
+// the board is rejected
+int feasibilityEx(const char* board,
+                  int min_erase,
+                  pazusoba::profile* profiles,
+                  int count,
+                  c_verdict* verdicts) {
+    std::string error;
+    if (!valid_board(board, error))
+        return -1;
+    auto solver = pazusoba::solver();
+    solver.set_board(board);
+    solver.set_min_erase(min_erase);
+    solver.set_profiles(profiles, count);
+
+    int feasible = 0;
+    const auto& list = solver.verdicts();
+    for (int i = 0; i < count; i++) {
+        verdicts[i].feasible = list[i].feasible;
+        verdicts[i].relaxed = list[i].relaxed;
+        verdicts[i].target = list[i].target;
+        verdicts[i].colour_target = list[i].colour_target;
+        if (list[i].feasible)
+            feasible++;
+    }
+    return feasible;
+}
+
+// Remove wasted moves from a route, see pazusoba::shorten_route. The new
+// route and its NUL are written to shortened which holds capacity chars,
+// route length + 1 is always enough. Returns how many steps are saved, -1
+// if the new route doesn't fit and nothing but an empty string is written
+int shortenEx(const char* board,
+              int row,
+              int column,
+              int start,
+              const char* route,
+              bool diagonal,
+              bool same_combo,
+              int min_erase,
+              char* shortened,
+              int capacity) {
+    pazusoba::route_options options;
+    options.allow_diagonal = diagonal;
+    options.same_combo = same_combo;
+    options.min_erase = min_erase;
+    auto result = pazusoba::shorten_route(board, row, column, start, route, options);
+    if ((int)result.route.size() >= capacity) {
+        if (capacity > 0)
+            shortened[0] = '\0';
+        return -1;
+    }
+    std::copy(result.route.begin(), result.route.end(), shortened);
+    shortened[result.route.size()] = '\0';
+    return result.saved;
+}
+
+// A search running in the background, profiles are copied so the caller
+// doesn't need to keep them
+struct c_async {
+    std::vector<pazusoba::profile> profiles;
+    pazusoba::async_solve* search = nullptr;
+};
+
+// Same as adventureEx() but it returns a handle right away, the handle must
+// be freed with asyncFree(). A bad board gives nullptr and nothing is started
+void* adventureAsync(const char* board,
+                     int min_erase,
+                     int search_depth,
+                     int beam_size,
+                     pazusoba::profile* profiles,
+                     int count) {
+    std::string error;
+    if (!valid_board(board, error))
+        return nullptr;
+    auto handle = new c_async();
+    handle->profiles.assign(profiles, profiles + count);
+    auto solver = pazusoba::solver();
+    solver.set_board(board);
+    solver.set_min_erase(min_erase);
+    solver.set_search_depth(search_depth);
+    solver.set_beam_size(beam_size);
+    solver.set_profiles(handle->profiles.data(), count);
+    handle->search = new pazusoba::async_solve(solver);
+    return handle;
+}
+
+c_progress asyncProgress(void* handle) {
+    auto p = static_cast<c_async*>(handle)->search->snapshot();
+    c_progress c_progress;
+    c_progress.depth = p.depth;
+    c_progress.best_score = p.best_score;
+    c_progress.best_combo = p.best_combo;
+    c_progress.expanded = p.expanded;
+    c_progress.cancelled = p.cancelled;
+    c_progress.finished = p.finished;
+    return c_progress;
+}
+
+bool asyncDone(void* handle) {
+    return static_cast<c_async*>(handle)->search->done();
+}
+
+void asyncCancel(void* handle) {
+    static_cast<c_async*>(handle)->search->cancel();
+}
+
+// Block until the search is done, it can be called after cancelling
+c_state asyncWait(void* handle) {
+    auto search = static_cast<c_async*>(handle)->search;
+    const auto& state = search->wait();
+    return convert(search->owner(), state);
+}
+
+// Cancel the search if it is still running and free the handle
+void asyncFree(void* handle) {
+    auto async = static_cast<c_async*>(handle);
+    delete async->search;
+    delete async;
+}
+
 c_state adventure(int argc, char* argv[]) {
     DEBUG_PRINT("Calling from shared library\n");
     for (int i = 0; i < argc; i++) {
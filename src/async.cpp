@@ -0,0 +1,92 @@
+// async.cpp
+// Progress of a running search and searching on another thread.
+
+#include <pazusoba/core.h>
+#include <chrono>
+
+namespace pazusoba {
+
+void search_progress::reset() {
+    publish(0, 0, MIN_STATE_SCORE);
+    EXPANDED = 0;
+    FINISHED = false;
+}
+
+void search_progress::publish(const int depth, const int combo, const int score) {
+    long long int packed = (long long int)(depth & 0xffff) << 48 |
+                           (long long int)(combo & 0xffff) << 32 |
+                           (unsigned int)score;
+    BEST.store(packed, std::memory_order_relaxed);
+}
+
+void search_progress::add_expanded(const long long int count) {
+    EXPANDED.fetch_add(count, std::memory_order_relaxed);
+}
+
+void search_progress::finish() {
+    FINISHED = true;
+}
+
+void search_progress::cancel() {
+    CANCELLED = true;
+}
+
+void search_progress::set_deadline(const std::chrono::steady_clock::time_point& deadline) {
+    DEADLINE.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool search_progress::cancelled() {
+    if (CANCELLED.load(std::memory_order_relaxed))
+        return true;
+    long long int deadline = DEADLINE.load(std::memory_order_relaxed);
+    if (deadline != 0 &&
+        std::chrono::steady_clock::now().time_since_epoch().count() > deadline) {
+        TIMED_OUT = true;
+        CANCELLED = true;
+        return true;
+    }
+    return false;
+}
+
+progress search_progress::snapshot() const {
+    long long int packed = BEST.load(std::memory_order_relaxed);
+    progress p;
+    p.depth = (packed >> 48) & 0xffff;
+    p.best_combo = (packed >> 32) & 0xffff;
+    p.best_score = (int)(unsigned int)(packed & 0xffffffff);
+    p.expanded = EXPANDED.load(std::memory_order_relaxed);
+    p.cancelled = CANCELLED;
+    p.timed_out = TIMED_OUT;
+    p.finished = FINISHED;
+    return p;
+}
+
+async_solve::async_solve(const solver& s) : SOLVER(s) {
+    SOLVER.set_progress(&PROGRESS);
+    FUTURE = std::async(std::launch::async, [this] { return SOLVER.adventure(); });
+}
+
+async_solve::~async_solve() {
+    cancel();
+    if (FUTURE.valid())
+        FUTURE.wait();
+}
+
+void async_solve::cancel() {
+    PROGRESS.cancel();
+}
+
+bool async_solve::done() const {
+    return WAITED ||
+           FUTURE.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+const state& async_solve::wait() {
+    if (!WAITED) {
+        RESULT = FUTURE.get();
+        WAITED = true;
+    }
+    return RESULT;
+}
+
+}  // namespace pazusoba
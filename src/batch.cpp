@@ -0,0 +1,74 @@
+// batch.cpp
+// Solving many boards one by one leaves most threads idle between depths
+// of a small beam, small jobs are spread over the threads instead.
+
+#include <pazusoba/core.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace pazusoba {
+
+std::vector<state> solve_batch(std::vector<solver>& solvers, const batch_options& options) {
+    int count = solvers.size();
+    std::vector<state> results(count);
+    if (count == 0)
+        return results;
+
+    int threads = options.threads;
+    if (threads <= 0)
+        threads = default_thread_count();
+
+    std::vector<int> small;
+    std::vector<int> large;
+    for (int i = 0; i < count; i++) {
+        long long int size = (long long int)solvers[i].beam_size() * solvers[i].search_depth();
+        if (threads > 1 && size > options.split_threshold)
+            large.push_back(i);
+        else
+            small.push_back(i);
+    }
+
+    std::mutex result_mutex;
+    auto finish = [&](int index, const state& best) {
+        results[index] = best;
+        if (options.on_result) {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            options.on_result(index, best);
+        }
+    };
+
+    // every thread keeps its own buffers and takes the next small job
+    std::vector<std::unique_ptr<workspace>> spaces;
+    for (int t = 0; t < threads; t++)
+        spaces.emplace_back(new workspace());
+    worker_pool pool;
+    std::atomic<int> next{0};
+    pool.run(std::min<int>(threads, small.size()), [&](int thread_num) {
+        for (int i = next++; i < (int)small.size(); i = next++) {
+            auto& s = solvers[small[i]];
+            int before = s.threads();
+            workspace* space = s.current_workspace();
+            s.set_threads(1);
+            s.set_workspace(spaces[thread_num].get());
+            finish(small[i], s.adventure());
+            s.set_workspace(space);
+            s.set_threads(before);
+        }
+    });
+
+    // a large beam is split over every thread on its own
+    for (int index : large) {
+        auto& s = solvers[index];
+        int before = s.threads();
+        workspace* space = s.current_workspace();
+        s.set_threads(threads);
+        s.set_workspace(spaces[0].get());
+        finish(index, s.adventure());
+        s.set_workspace(space);
+        s.set_threads(before);
+    }
+    return results;
+}
+
+}  // namespace pazusoba
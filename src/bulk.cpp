@@ -0,0 +1,235 @@
+// bulk.cpp
+// Solve a file of boards in one process, lines are read in batches which
+// are solved in parallel and printed in the order they were read so runs
+// can be compared with diff. Board corpus files are read the same way
+// without parsing any text.
+
+#include <pazusoba/core.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace pazusoba {
+namespace {
+
+// lines read at once for every job, more keeps the threads busy at the
+// end of a batch but delays the first results
+const int LINES_PER_JOB = 8;
+
+struct bulk_line {
+    solve_request request;
+    solve_response response;
+    bool parsed = false;
+    int expected_combo = -1;
+};
+
+// a corpus record as a request, the options still come from the defaults
+bulk_line corpus_line(const corpus_record& record, int index, const solve_request& defaults) {
+    bulk_line line;
+    line.request = defaults;
+    line.request.id = std::to_string(index + 1);
+    line.request.board = record.board();
+    auto mask = record.blocked_mask();
+    if (mask != 0) {
+        line.request.blocked.clear();
+        for (int i = 0; i < record.size(); i++) {
+            if (mask >> i & 1)
+                line.request.blocked.push_back(i);
+        }
+    }
+    line.expected_combo = record.expected_combo();
+    line.response.id = line.request.id;
+    // the same checks as a text line, set_board() would exit on a bad orb
+    line.parsed = validate_request(line.request, line.response.error);
+    return line;
+}
+
+bool is_corpus(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4] = {};
+    file.read(magic, 4);
+    return file && memcmp(magic, "PZBC", 4) == 0;
+}
+
+}  // namespace
+
+int run_bulk(const bulk_options& options) {
+    solve_request defaults;
+    std::string error;
+    if (!parse_options(options.defaults, defaults, error)) {
+        printf("Invalid default options - %s\n", error.c_str());
+        return 1;
+    }
+
+    corpus_reader corpus;
+    bool from_stdin = options.path.empty() || options.path == "-";
+    bool from_corpus = !from_stdin && is_corpus(options.path);
+    if (from_corpus && !corpus.open(options.path)) {
+        printf("%s\n", corpus.error().c_str());
+        return 1;
+    }
+
+    std::ifstream file;
+    if (!from_stdin && !from_corpus) {
+        file.open(options.path);
+        if (!file.is_open()) {
+            printf("Can't open %s\n", options.path.c_str());
+            return 1;
+        }
+    }
+    std::istream& input = from_stdin ? std::cin : file;
+
+    int jobs = std::max(options.jobs, 1);
+    int threads = options.threads;
+    if (threads <= 0)
+        threads = default_thread_count();
+    int threads_per_job = std::max(threads / jobs, 1);
+
+    std::vector<std::unique_ptr<workspace>> spaces;
+    for (int i = 0; i < jobs; i++)
+        spaces.emplace_back(new workspace());
+    worker_pool pool;
+    solution_cache cache;
+    if (!options.cache.empty() && !cache.open(options.cache, options.cache_size)) {
+        printf("%s\n", cache.error().c_str());
+        return 1;
+    }
+
+    std::string text;
+    int line_number = 0;
+    int record = 0;
+    bool more = true;
+    std::vector<bulk_line> batch;
+    while (more) {
+        batch.clear();
+        while ((int)batch.size() < jobs * LINES_PER_JOB) {
+            if (from_corpus) {
+                if (record == corpus.count()) {
+                    more = false;
+                    break;
+                }
+                batch.push_back(corpus_line(corpus[record], record, defaults));
+                record++;
+                continue;
+            }
+            if (!std::getline(input, text)) {
+                more = false;
+                break;
+            }
+            line_number++;
+            size_t first = text.find_first_not_of(" \t\r");
+            if (first == std::string::npos || text[first] == '#')
+                continue;
+
+            bulk_line line;
+            line.request = defaults;
+            line.request.id = std::to_string(line_number);
+            line.parsed = parse_request(text, line.request, line.response.error);
+            line.response.id = line.request.id;
+            batch.push_back(line);
+        }
+
+        std::atomic<int> next{0};
+        pool.run(std::min<int>(jobs, batch.size()), [&](int job) {
+            for (int i = next++; i < (int)batch.size(); i = next++) {
+                auto& line = batch[i];
+                if (line.parsed)
+                    line.response = solve_request_with(line.request, *spaces[job], threads_per_job,
+                                                       options.cache.empty() ? nullptr : &cache);
+            }
+        });
+
+        for (const auto& line : batch) {
+            // regression sets note every board that doesn't match anymore
+            if (line.expected_combo >= 0 && line.response.ok &&
+                line.response.combo != line.expected_combo)
+                printf("%s expected=%d\n", format_response(line.response).c_str(),
+                       line.expected_combo);
+            else
+                printf("%s\n", format_response(line.response).c_str());
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+
+int run_pack(const std::string& path, const std::string& output) {
+    std::ifstream file;
+    bool from_stdin = path.empty() || path == "-";
+    if (!from_stdin) {
+        file.open(path);
+        if (!file.is_open()) {
+            printf("Can't open %s\n", path.c_str());
+            return 1;
+        }
+    }
+    std::istream& input = from_stdin ? std::cin : file;
+
+    // everything is read first, the flags of the corpus depend on every line
+    std::vector<bulk_line> lines;
+    std::string text;
+    int flags = 0;
+    int line_number = 0;
+    while (std::getline(input, text)) {
+        line_number++;
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos || text[first] == '#')
+            continue;
+
+        bulk_line line;
+        std::stringstream ss(text);
+        std::string token, rest;
+        while (ss >> token) {
+            if (token.compare(0, 9, "expected=") == 0)
+                line.expected_combo = atoi(token.c_str() + 9);
+            else
+                rest += token + " ";
+        }
+        if (!parse_request(rest, line.request, line.response.error)) {
+            printf("Line %d - %s\n", line_number, line.response.error.c_str());
+            return 1;
+        }
+        if (!lines.empty() && line.request.board.size() != lines[0].request.board.size()) {
+            printf("Line %d - every board needs the same size\n", line_number);
+            return 1;
+        }
+        if (!line.request.blocked.empty())
+            flags |= corpus_blocked;
+        if (line.expected_combo >= 0)
+            flags |= corpus_expected_combo;
+        lines.push_back(line);
+    }
+    if (lines.empty()) {
+        printf("No boards to pack\n");
+        return 1;
+    }
+
+    int size = lines[0].request.board.size();
+    int rows = size == 20 ? 4 : size == 30 ? 5 : 6;
+    corpus_writer writer;
+    if (!writer.open(output, rows, size / rows, flags)) {
+        printf("%s\n", writer.error().c_str());
+        return 1;
+    }
+    for (const auto& line : lines) {
+        unsigned long long int mask = 0;
+        for (int index : line.request.blocked)
+            mask |= 1ULL << index;
+        writer.add(line.request.board, mask, line.expected_combo);
+    }
+    if (!writer.close()) {
+        printf("Can't write %s\n", output.c_str());
+        return 1;
+    }
+    printf("Packed %d boards into %s\n", writer.count(), output.c_str());
+    return 0;
+}
+
+}  // namespace pazusoba
@@ -0,0 +1,441 @@
+// cache.cpp
+// Boards repeat because of fixed spawns and retries, a board which has been
+// solved before is answered from the cache instead of searching again.
+// Mirrored boards and boards with the colours swapped share one entry.
+
+#include <pazusoba/core.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pazusoba {
+
+struct solution_cache::header {
+    char magic[4];
+    unsigned int version;
+    unsigned int entry_size;
+    unsigned int sets;
+    unsigned int ways;
+    unsigned int reserved;
+    // increases with every hit and store, entries remember it when used
+    unsigned long long int clock;
+    unsigned char padding[32];
+};
+
+namespace {
+
+static_assert(sizeof(cache_entry) == 256, "cache entries are mapped from the file");
+
+const char CACHE_MAGIC[4] = {'P', 'Z', 'S', 'C'};
+const size_t HEADER_SIZE = 64;
+// left and right, up left and up right, down left and down right swap
+const int MIRRORED_DIRECTION[DIRECTION_COUNT] = {up,       down,      right,      left,
+                                                 up_right, up_left,   down_right, down_left};
+
+void pack_board(const game_board& board, int size, unsigned char* out) {
+    memset(out, 0, MAX_BOARD_LENGTH / 2);
+    for (int i = 0; i < size; i++)
+        out[i / 2] |= board[i] << (i % 2 * 4);
+}
+
+game_board unpack_board(const unsigned char* in, int size) {
+    game_board board{};
+    for (int i = 0; i < size; i++)
+        board[i] = (in[i / 2] >> (i % 2 * 4)) & 0xf;
+    return board;
+}
+
+unsigned long long int key_of(const unsigned char* packed, unsigned long long int blocked,
+                              unsigned long long int settings) {
+    unsigned long long int key = cache_mix(CACHE_SEED, settings);
+    key = cache_mix(key, blocked);
+    for (int i = 0; i < MAX_BOARD_LENGTH / 2; i++)
+        key = cache_mix(key, packed[i]);
+    // 0 marks empty slots
+    return key == 0 ? 1 : key;
+}
+
+size_t file_length(int sets) {
+    return HEADER_SIZE + (size_t)sets * CACHE_WAYS * sizeof(cache_entry);
+}
+
+}  // namespace
+
+canonical_board::canonical_board(const game_board& board,
+                                 int rows,
+                                 int columns,
+                                 const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                                 const bool* fixed)
+    : ROWS(rows), COLUMNS(columns) {
+    int size = rows * columns;
+    // relabel free colours in the order they first show up, for the board
+    // as it is and mirrored, then keep the smaller one
+    for (int mirror = 0; mirror < 2; mirror++) {
+        orb to_canonical[ORB_COUNT]{};
+        bool assigned[ORB_COUNT]{};
+        bool taken[ORB_COUNT]{};
+        for (int o = 0; o < ORB_COUNT; o++) {
+            if (o == 0 || (fixed && fixed[o])) {
+                to_canonical[o] = o;
+                assigned[o] = taken[o] = true;
+            }
+        }
+        int next = 1;
+        auto assign = [&](orb o) {
+            while (taken[next])
+                next++;
+            to_canonical[o] = next;
+            assigned[o] = taken[next] = true;
+        };
+
+        game_board relabelled{};
+        unsigned long long int mask = 0;
+        for (int i = 0; i < size; i++) {
+            int from = mirror ? i - i % columns + (columns - 1 - i % columns) : i;
+            orb o = board[from];
+            if (!assigned[o])
+                assign(o);
+            relabelled[i] = to_canonical[o];
+            if (blocked[from])
+                mask |= 1ULL << i;
+        }
+        // colours which aren't on the board still need a label of their own
+        for (int o = 0; o < ORB_COUNT; o++) {
+            if (!assigned[o])
+                assign(o);
+        }
+
+        if (mirror == 1 && (BOARD < relabelled || (BOARD == relabelled && BLOCKED <= mask)))
+            continue;
+        MIRRORED = mirror == 1;
+        BOARD = relabelled;
+        BLOCKED = mask;
+        for (int o = 0; o < ORB_COUNT; o++) {
+            TO_CANONICAL[o] = to_canonical[o];
+            TO_CALLER[to_canonical[o]] = o;
+        }
+    }
+}
+
+int canonical_board::position(int p) const {
+    if (!MIRRORED)
+        return p;
+    return p - p % COLUMNS + (COLUMNS - 1 - p % COLUMNS);
+}
+
+int canonical_board::direction(int d) const {
+    return MIRRORED ? MIRRORED_DIRECTION[d] : d;
+}
+
+game_board canonical_board::to_caller(const game_board& board) const {
+    game_board out{};
+    for (int i = 0; i < size(); i++)
+        out[position(i)] = TO_CALLER[board[i]];
+    return out;
+}
+
+game_board canonical_board::to_canonical(const game_board& board) const {
+    game_board out{};
+    for (int i = 0; i < size(); i++)
+        out[i] = TO_CANONICAL[board[position(i)]];
+    return out;
+}
+
+bool solution_cache::map(int sets) {
+    LENGTH = file_length(sets);
+#ifndef _WIN32
+    if (!PATH.empty()) {
+        int fd = ::open(PATH.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            ERROR = "can't open " + PATH;
+            return false;
+        }
+        // another process writing the same entries would corrupt them
+        if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+            ::close(fd);
+            ERROR = PATH + " is used by another process";
+            return false;
+        }
+        struct stat info;
+        bool fresh = fstat(fd, &info) < 0 || (size_t)info.st_size != LENGTH;
+        if (fresh && ftruncate(fd, LENGTH) < 0) {
+            ::close(fd);
+            ERROR = "can't resize " + PATH;
+            return false;
+        }
+        void* mapped = mmap(nullptr, LENGTH, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            ERROR = "can't map " + PATH;
+            return false;
+        }
+        DATA = static_cast<unsigned char*>(mapped);
+        LOCK_FD = fd;
+        return true;
+    }
+#endif
+    BUFFER.assign(LENGTH, 0);
+    if (!PATH.empty()) {
+        std::ifstream file(PATH, std::ios::binary);
+        file.read(reinterpret_cast<char*>(BUFFER.data()), LENGTH);
+    }
+    DATA = BUFFER.data();
+    return true;
+}
+
+bool solution_cache::open(const std::string& path, int capacity) {
+    close();
+    std::lock_guard<std::mutex> lock(MUTEX);
+    PATH = path;
+    int sets = std::max((capacity + CACHE_WAYS - 1) / CACHE_WAYS, 1);
+
+    // an existing cache decides its own size
+    if (!path.empty()) {
+        std::ifstream file(path, std::ios::binary);
+        header existing;
+        if (file.read(reinterpret_cast<char*>(&existing), sizeof(existing)) &&
+            memcmp(existing.magic, CACHE_MAGIC, 4) == 0 && existing.version == CACHE_VERSION &&
+            existing.entry_size == sizeof(cache_entry) && existing.ways == CACHE_WAYS &&
+            existing.sets > 0) {
+            file.seekg(0, std::ios::end);
+            if ((size_t)file.tellg() == file_length(existing.sets))
+                sets = existing.sets;
+        }
+    }
+    if (!map(sets)) {
+        DATA = nullptr;
+        LENGTH = 0;
+        return false;
+    }
+
+    HEADER = reinterpret_cast<header*>(DATA);
+    ENTRIES = reinterpret_cast<cache_entry*>(DATA + HEADER_SIZE);
+    SETS = sets;
+    bool valid = memcmp(HEADER->magic, CACHE_MAGIC, 4) == 0 &&
+                 HEADER->version == CACHE_VERSION && HEADER->sets == (unsigned int)sets;
+    if (!valid) {
+        memset(DATA, 0, LENGTH);
+        memcpy(HEADER->magic, CACHE_MAGIC, 4);
+        HEADER->version = CACHE_VERSION;
+        HEADER->entry_size = sizeof(cache_entry);
+        HEADER->sets = sets;
+        HEADER->ways = CACHE_WAYS;
+    }
+    SIZE = 0;
+    for (int i = 0; i < sets * CACHE_WAYS; i++) {
+        if (ENTRIES[i].key != 0)
+            SIZE++;
+    }
+    ERROR.clear();
+    return true;
+}
+
+void solution_cache::close() {
+    std::lock_guard<std::mutex> lock(MUTEX);
+    if (DATA == nullptr)
+        return;
+#ifndef _WIN32
+    if (BUFFER.empty()) {
+        msync(DATA, LENGTH, MS_SYNC);
+        munmap(DATA, LENGTH);
+    }
+    if (LOCK_FD >= 0) {
+        ::close(LOCK_FD);
+        LOCK_FD = -1;
+    }
+#endif
+    if (!BUFFER.empty() && !PATH.empty()) {
+        std::ofstream file(PATH, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(BUFFER.data()), BUFFER.size());
+    }
+    BUFFER.clear();
+    DATA = nullptr;
+    HEADER = nullptr;
+    ENTRIES = nullptr;
+    LENGTH = 0;
+    SETS = 0;
+    SIZE = 0;
+}
+
+bool solution_cache::find(const canonical_board& board,
+                          unsigned long long int settings,
+                          cached_solution& solution) {
+    unsigned char packed[MAX_BOARD_LENGTH / 2];
+    pack_board(board.board(), board.size(), packed);
+    auto key = key_of(packed, board.blocked(), settings);
+
+    std::lock_guard<std::mutex> lock(MUTEX);
+    if (DATA == nullptr)
+        return false;
+    cache_entry* set = ENTRIES + key % SETS * CACHE_WAYS;
+    for (int i = 0; i < CACHE_WAYS; i++) {
+        cache_entry& entry = set[i];
+        // the key is only a hash, everything it covers is compared as well
+        if (entry.key != key || entry.settings != settings || entry.blocked != board.blocked() ||
+            memcmp(entry.board, packed, sizeof(packed)) != 0)
+            continue;
+
+        entry.used = ++HEADER->clock;
+        solution.success = entry.success != 0;
+        solution.begin = entry.begin;
+        solution.combo = entry.combo;
+        solution.max_combo = entry.max_combo;
+        solution.colour = entry.colour;
+        solution.final_board = unpack_board(entry.final_board, board.size());
+        solution.directions.resize(entry.steps);
+        for (int s = 0; s < entry.steps; s++)
+            solution.directions[s] = (entry.route[s / 2] >> (s % 2 * 4)) & 0xf;
+        HITS++;
+        return true;
+    }
+    MISSES++;
+    return false;
+}
+
+void solution_cache::store(const canonical_board& board,
+                           unsigned long long int settings,
+                           const cached_solution& solution) {
+    if ((int)solution.directions.size() > CACHE_ROUTE_BYTES * 2)
+        return;
+    cache_entry fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    pack_board(board.board(), board.size(), fresh.board);
+    pack_board(solution.final_board, board.size(), fresh.final_board);
+    fresh.key = key_of(fresh.board, board.blocked(), settings);
+    fresh.settings = settings;
+    fresh.blocked = board.blocked();
+    fresh.steps = solution.directions.size();
+    fresh.begin = solution.begin < 0 ? 0xff : solution.begin;
+    fresh.combo = solution.combo;
+    fresh.max_combo = solution.max_combo;
+    fresh.colour = solution.colour;
+    fresh.success = solution.success;
+    for (int s = 0; s < fresh.steps; s++)
+        fresh.route[s / 2] |= solution.directions[s] << (s % 2 * 4);
+
+    std::lock_guard<std::mutex> lock(MUTEX);
+    if (DATA == nullptr)
+        return;
+    cache_entry* set = ENTRIES + fresh.key % SETS * CACHE_WAYS;
+    // the same board again, then an empty slot, then the oldest one
+    cache_entry* slot = nullptr;
+    for (int i = 0; i < CACHE_WAYS && slot == nullptr; i++) {
+        if (set[i].key == fresh.key && set[i].settings == settings &&
+            set[i].blocked == fresh.blocked &&
+            memcmp(set[i].board, fresh.board, sizeof(fresh.board)) == 0)
+            slot = &set[i];
+    }
+    for (int i = 0; i < CACHE_WAYS && slot == nullptr; i++) {
+        if (set[i].key == 0) {
+            slot = &set[i];
+            SIZE++;
+        }
+    }
+    if (slot == nullptr) {
+        slot = set;
+        for (int i = 1; i < CACHE_WAYS; i++) {
+            if (set[i].used < slot->used)
+                slot = &set[i];
+        }
+        EVICTIONS++;
+    }
+    fresh.used = ++HEADER->clock;
+    *slot = fresh;
+}
+
+int solution_cache::size() const {
+    std::lock_guard<std::mutex> lock(MUTEX);
+    return SIZE;
+}
+
+long long int solution_cache::hits() const {
+    std::lock_guard<std::mutex> lock(MUTEX);
+    return HITS;
+}
+
+long long int solution_cache::misses() const {
+    std::lock_guard<std::mutex> lock(MUTEX);
+    return MISSES;
+}
+
+long long int solution_cache::evictions() const {
+    std::lock_guard<std::mutex> lock(MUTEX);
+    return EVICTIONS;
+}
+
+unsigned long long int solver::cache_settings() const {
+    unsigned long long int settings = cache_mix(CACHE_SEED, ROW);
+    settings = cache_mix(settings, COLUMN);
+    settings = cache_mix(settings, MIN_ERASE);
+    settings = cache_mix(settings, SEARCH_DEPTH);
+    settings = cache_mix(settings, BEAM_SIZE);
+    settings = cache_mix(settings, ALLOW_DIAGONAL);
+    settings = cache_mix(settings, PRUNING);
+    settings = cache_mix(settings, REFINE_DEPTH);
+    settings = cache_mix(settings, REFINE_CANDIDATES);
+    settings = cache_mix(settings, REFINE_TIME);
+    settings = cache_mix(settings, SHORTEN);
+    settings = cache_mix(settings, (long long int)(COMMIT_RATIO * 1000000));
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        const auto& p = PROFILES[i];
+        settings = cache_mix(settings, p.name);
+        settings = cache_mix(settings, p.stop_threshold);
+        settings = cache_mix(settings, p.target);
+        settings = cache_mix(settings, p.colour_target);
+        for (int o = 0; o < ORB_COUNT; o++)
+            settings = cache_mix(settings, p.orbs[o]);
+    }
+    return settings;
+}
+
+canonical_board solver::canonical() const {
+    // colours any profile asks for can't be swapped
+    bool fixed[ORB_COUNT]{};
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        for (int o = 0; o < ORB_COUNT; o++)
+            fixed[o] = fixed[o] || PROFILES[i].orbs[o];
+    }
+    return canonical_board(BOARD, ROW, COLUMN, BLOCKED, fixed);
+}
+
+bool solver::load_cached(state& result) {
+    auto board = canonical();
+    cached_solution solution;
+    if (!CACHE->find(board, cache_settings(), solution))
+        return false;
+
+    result = state();
+    result.begin = board.position(solution.begin);
+    result.curr = result.begin;
+    result.prev = result.begin;
+    result.board = BOARD;
+    for (int direction : solution.directions)
+        move(result, board.direction(direction));
+    result.hash = hash::pazusoba_hash(result.board.data(), result.curr);
+    auto copy = result.board;
+    evaluate(copy, result);
+    return true;
+}
+
+void solver::store_cached(const state& result) {
+    auto board = canonical();
+    cached_solution solution;
+    solution.success = true;
+    solution.begin = board.position(result.begin);
+    solution.combo = result.combo;
+    solution.max_combo = MAX_COMBO;
+    solution.final_board = board.to_canonical(result.board);
+    for (int direction : decode_route(result.route, result.step))
+        solution.directions.push_back(board.direction(direction));
+    CACHE->store(board, cache_settings(), solution);
+}
+
+}  // namespace pazusoba
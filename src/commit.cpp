@@ -0,0 +1,93 @@
+// commit.cpp
+// Once most of the beam agrees on the first moves, they are decided and can
+// be executed while the rest of the route is still being searched.
+
+#include <pazusoba/core.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace pazusoba {
+
+bool solver::follows_commit(const state& current) const {
+    if (!COMMITTED_START)
+        return true;
+    if (current.begin != COMMITTED.begin || current.step < COMMITTED.step)
+        return false;
+    for (int i = 0; i < COMMITTED.step; i++) {
+        if (route_direction(current.route, current.step, i) !=
+            route_direction(COMMITTED.route, COMMITTED.step, i))
+            return false;
+    }
+    return true;
+}
+
+bool solver::commit_prefix(std::vector<state>& look) {
+    int needed = std::max(1, (int)std::ceil(look.size() * COMMIT_RATIO));
+    bool grown = false;
+
+    // every state in the beam already follows the committed prefix
+    if (!COMMITTED_START) {
+        int count[MAX_BOARD_LENGTH]{0};
+        int begin = 0;
+        for (const auto& s : look) {
+            if (++count[s.begin] > count[begin])
+                begin = s.begin;
+        }
+        if (count[begin] < needed)
+            return false;
+
+        COMMITTED_START = true;
+        COMMITTED = state();
+        COMMITTED.begin = begin;
+        COMMITTED.curr = begin;
+        COMMITTED.prev = begin;
+        COMMITTED.board = BOARD;
+        look.erase(std::remove_if(look.begin(), look.end(),
+                                  [begin](const state& s) { return s.begin != begin; }),
+                   look.end());
+        grown = true;
+    }
+
+    while (true) {
+        int index = COMMITTED.step;
+        int count[DIRECTION_COUNT]{0};
+        int direction = 0;
+        for (const auto& s : look) {
+            if (s.step <= index)
+                continue;
+            int d = route_direction(s.route, s.step, index);
+            if (++count[d] > count[direction])
+                direction = d;
+        }
+        if (count[direction] < needed)
+            break;
+
+        look.erase(std::remove_if(look.begin(), look.end(),
+                                  [&](const state& s) {
+                                      return s.step <= index ||
+                                             route_direction(s.route, s.step, index) != direction;
+                                  }),
+                   look.end());
+
+        int next = COMMITTED.curr + DIRECTION_ADJUSTMENTS[direction];
+        std::swap(COMMITTED.board[COMMITTED.curr], COMMITTED.board[next]);
+        COMMITTED.prev = COMMITTED.curr;
+        COMMITTED.curr = next;
+        COMMITTED.step++;
+        int route_index = COMMITTED.step / ROUTE_PER_LIST;
+        if (COMMITTED.step % ROUTE_PER_LIST == 0)
+            route_index--;
+        COMMITTED.route[route_index] = COMMITTED.route[route_index] << 3 | direction;
+        grown = true;
+    }
+
+    if (grown) {
+        COMMITTED.hash = hash::pazusoba_hash(COMMITTED.board.data(), COMMITTED.curr);
+        DEBUG_PRINT("Committed %d steps from %d, %zu states left\n",
+                    COMMITTED.step, COMMITTED.begin, look.size());
+    }
+    return grown;
+}
+
+}  // namespace pazusoba
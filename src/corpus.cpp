@@ -0,0 +1,224 @@
+// corpus.cpp
+// Loose text boards take a parse for every board, a corpus is mapped once
+// and its records are read where they are.
+
+#include <pazusoba/core.h>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pazusoba {
+namespace {
+
+const char CORPUS_MAGIC[4] = {'P', 'Z', 'B', 'C'};
+
+int record_size(int size, int flags) {
+    int bytes = (size + 1) / 2;
+    if (flags & corpus_blocked)
+        bytes += 8;
+    if (flags & corpus_expected_combo)
+        bytes += 1;
+    return bytes;
+}
+
+void write_u32(unsigned char* out, unsigned int value) {
+    for (int i = 0; i < 4; i++)
+        out[i] = (value >> (i * 8)) & 0xff;
+}
+
+unsigned int read_u32(const unsigned char* in) {
+    unsigned int value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= (unsigned int)in[i] << (i * 8);
+    return value;
+}
+
+bool valid_size(int rows, int columns) {
+    return (rows == 4 && columns == 5) || (rows == 5 && columns == 6) ||
+           (rows == 6 && columns == 7);
+}
+
+}  // namespace
+
+void corpus_record::unpack(game_board& board) const {
+    board.fill(0);
+    for (int i = 0; i < SIZE; i++)
+        board[i] = at(i);
+}
+
+void corpus_record::board_string(char* out) const {
+    // a foreign or corrupt file may have any nibble
+    for (int i = 0; i < SIZE; i++)
+        out[i] = at(i) < ORB_COUNT ? ORB_WEB_NAME[at(i)] : '?';
+    out[SIZE] = '\0';
+}
+
+std::string corpus_record::board() const {
+    char text[MAX_BOARD_LENGTH + 1];
+    board_string(text);
+    return text;
+}
+
+unsigned long long int corpus_record::blocked_mask() const {
+    if (!(FLAGS & corpus_blocked))
+        return 0;
+    const unsigned char* mask = DATA + (SIZE + 1) / 2;
+    unsigned long long int value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= (unsigned long long int)mask[i] << (i * 8);
+    return value;
+}
+
+int corpus_record::expected_combo() const {
+    if (!(FLAGS & corpus_expected_combo))
+        return -1;
+    int offset = (SIZE + 1) / 2 + ((FLAGS & corpus_blocked) ? 8 : 0);
+    int combo = DATA[offset];
+    return combo == 0xff ? -1 : combo;
+}
+
+bool corpus_reader::open(const std::string& path) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        ERROR = "can't open " + path;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < CORPUS_HEADER_SIZE) {
+        ::close(fd);
+        ERROR = path + " is too small to be a corpus";
+        return false;
+    }
+    LENGTH = info.st_size;
+    void* mapped = mmap(nullptr, LENGTH, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        LENGTH = 0;
+        ERROR = "can't map " + path;
+        return false;
+    }
+    DATA = static_cast<const unsigned char*>(mapped);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        ERROR = "can't open " + path;
+        return false;
+    }
+    BUFFER.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (BUFFER.size() < CORPUS_HEADER_SIZE) {
+        BUFFER.clear();
+        ERROR = path + " is too small to be a corpus";
+        return false;
+    }
+    DATA = BUFFER.data();
+    LENGTH = BUFFER.size();
+#endif
+
+    if (memcmp(DATA, CORPUS_MAGIC, 4) != 0 || DATA[4] != CORPUS_VERSION) {
+        close();
+        ERROR = path + " is not a corpus of version " + std::to_string(CORPUS_VERSION);
+        return false;
+    }
+    FLAGS = DATA[5];
+    ROWS = DATA[6];
+    COLUMNS = DATA[7];
+    COUNT = read_u32(DATA + 8);
+    RECORD_SIZE = read_u32(DATA + 12);
+    if (!valid_size(ROWS, COLUMNS) || RECORD_SIZE != record_size(ROWS * COLUMNS, FLAGS) ||
+        LENGTH < CORPUS_HEADER_SIZE + (size_t)COUNT * RECORD_SIZE) {
+        close();
+        ERROR = path + " has a broken header";
+        return false;
+    }
+    ERROR.clear();
+    return true;
+}
+
+void corpus_reader::close() {
+#ifndef _WIN32
+    if (DATA != nullptr)
+        munmap(const_cast<unsigned char*>(DATA), LENGTH);
+#endif
+    BUFFER.clear();
+    DATA = nullptr;
+    LENGTH = 0;
+    COUNT = 0;
+}
+
+bool corpus_writer::open(const std::string& path, int rows, int columns, int flags) {
+    close();
+    if (!valid_size(rows, columns)) {
+        ERROR = "unsupported board size";
+        return false;
+    }
+    FILE_HANDLE = fopen(path.c_str(), "wb");
+    if (FILE_HANDLE == nullptr) {
+        ERROR = "can't write " + path;
+        return false;
+    }
+    ROWS = rows;
+    COLUMNS = columns;
+    FLAGS = flags;
+    COUNT = 0;
+
+    // the count is filled in when closing
+    unsigned char header[CORPUS_HEADER_SIZE]{};
+    memcpy(header, CORPUS_MAGIC, 4);
+    header[4] = CORPUS_VERSION;
+    header[5] = flags;
+    header[6] = rows;
+    header[7] = columns;
+    write_u32(header + 12, record_size(rows * columns, flags));
+    fwrite(header, 1, CORPUS_HEADER_SIZE, FILE_HANDLE);
+    return true;
+}
+
+bool corpus_writer::add(const std::string& board, unsigned long long int blocked, int expected_combo) {
+    int size = ROWS * COLUMNS;
+    if (FILE_HANDLE == nullptr || (int)board.size() != size) {
+        ERROR = "board doesn't match the corpus size";
+        return false;
+    }
+
+    unsigned char record[MAX_BOARD_LENGTH]{};
+    for (int i = 0; i < size; i++) {
+        const char* found = (const char*)memchr(ORB_WEB_NAME, board[i], ORB_COUNT);
+        if (found == nullptr) {
+            ERROR = std::string("invalid orb ") + board[i];
+            return false;
+        }
+        record[i / 2] |= (found - ORB_WEB_NAME) << (i % 2 * 4);
+    }
+    int bytes = (size + 1) / 2;
+    if (FLAGS & corpus_blocked) {
+        for (int i = 0; i < 8; i++)
+            record[bytes++] = (blocked >> (i * 8)) & 0xff;
+    }
+    if (FLAGS & corpus_expected_combo)
+        record[bytes++] = expected_combo < 0 ? 0xff : expected_combo;
+    fwrite(record, 1, bytes, FILE_HANDLE);
+    COUNT++;
+    return true;
+}
+
+bool corpus_writer::close() {
+    if (FILE_HANDLE == nullptr)
+        return false;
+    unsigned char count[4];
+    write_u32(count, COUNT);
+    fseek(FILE_HANDLE, 8, SEEK_SET);
+    fwrite(count, 1, 4, FILE_HANDLE);
+    bool ok = fclose(FILE_HANDLE) == 0;
+    FILE_HANDLE = nullptr;
+    return ok;
+}
+
+}  // namespace pazusoba
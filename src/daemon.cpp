@@ -0,0 +1,388 @@
+// daemon.cpp
+// A long running solver, starting a process for every board pays for the
+// startup and cold buffers every time. Clients queue requests onto a few
+// workers which keep their workspace between requests.
+
+#include <pazusoba/core.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace pazusoba {
+namespace {
+
+volatile std::sig_atomic_t STOP = 0;
+// set by SIGUSR1, the metrics thread writes them to stderr
+volatile std::sig_atomic_t DUMP = 0;
+
+// Where the answers of one client go, -1 writes to stdout
+struct connection {
+    int fd = -1;
+    std::mutex write_mutex;
+
+    explicit connection(int f) : fd(f) {}
+    ~connection() {
+#ifndef _WIN32
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    void send(const std::string& text) {
+        std::string line = text + "\n";
+        std::lock_guard<std::mutex> lock(write_mutex);
+        if (fd < 0) {
+            fwrite(line.data(), 1, line.size(), stdout);
+            fflush(stdout);
+            return;
+        }
+#ifndef _WIN32
+        size_t sent = 0;
+        while (sent < line.size()) {
+            // the client may be gone already, its answers are dropped
+            ssize_t n = ::send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                return;
+            sent += n;
+        }
+#endif
+    }
+};
+
+struct job {
+    std::shared_ptr<connection> client;
+    solve_request request;
+};
+
+class job_queue;
+
+// Shared by the readers and the workers
+struct daemon_context {
+    job_queue& queue;
+    daemon_metrics& metrics;
+    // shared by every worker, null without --cache
+    solution_cache* cache;
+};
+
+class job_queue {
+    std::mutex MUTEX;
+    std::condition_variable READY;
+    std::deque<job> JOBS;
+    bool CLOSED = false;
+
+public:
+    void push(job j) {
+        {
+            std::lock_guard<std::mutex> lock(MUTEX);
+            JOBS.push_back(std::move(j));
+        }
+        READY.notify_one();
+    }
+
+    // false once the queue is closed and empty
+    bool pop(job& j) {
+        std::unique_lock<std::mutex> lock(MUTEX);
+        READY.wait(lock, [this] { return CLOSED || !JOBS.empty(); });
+        if (JOBS.empty())
+            return false;
+        j = std::move(JOBS.front());
+        JOBS.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(MUTEX);
+            CLOSED = true;
+        }
+        READY.notify_all();
+    }
+};
+
+// Parse the line and queue it, bad lines are answered right away
+void handle_line(const std::string& line,
+                 int line_number,
+                 const std::shared_ptr<connection>& client,
+                 daemon_context& context) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+        return;
+    context.metrics.received();
+    job j;
+    j.client = client;
+    j.request.id = std::to_string(line_number);
+    std::string error;
+    if (!parse_request(line, j.request, error)) {
+        solve_response response;
+        response.id = j.request.id;
+        response.error = error;
+        context.metrics.rejected();
+        client->send(format_response(response));
+        return;
+    }
+    context.metrics.queued();
+    context.queue.push(std::move(j));
+}
+
+void work(daemon_context& context, int threads) {
+    workspace space;
+    job j;
+    while (context.queue.pop(j)) {
+        context.metrics.dequeued();
+        auto response = solve_request_with(j.request, space, threads, context.cache);
+        context.metrics.solved(j.request, response);
+        j.client->send(format_response(response));
+        j.client.reset();
+    }
+}
+
+#ifndef _WIN32
+void handle_signal(int) {
+    STOP = 1;
+}
+
+void handle_dump(int) {
+    DUMP = 1;
+}
+
+// A port on localhost or a unix socket path, -1 if it can't be listened on
+int listen_metrics(const std::string& where) {
+    bool port = where.find_first_not_of("0123456789") == std::string::npos;
+    int server = socket(port ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
+        return -1;
+    int result;
+    if (port) {
+        int reuse = 1;
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(std::atoi(where.c_str()));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        result = bind(server, (sockaddr*)&address, sizeof(address));
+    } else {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (where.size() >= sizeof(address.sun_path)) {
+            close(server);
+            return -1;
+        }
+        std::copy(where.begin(), where.end(), address.sun_path);
+        unlink(where.c_str());
+        result = bind(server, (sockaddr*)&address, sizeof(address));
+    }
+    if (result < 0 || listen(server, 4) < 0) {
+        close(server);
+        return -1;
+    }
+    return server;
+}
+
+// Answer every connection with the metrics over HTTP and dump them on
+// SIGUSR1 until the daemon is done
+void serve_metrics(int server, const daemon_metrics& metrics, const std::atomic<bool>& done) {
+    while (!done) {
+        if (DUMP) {
+            DUMP = 0;
+            std::string text = metrics.text();
+            fwrite(text.data(), 1, text.size(), stderr);
+            fflush(stderr);
+        }
+        if (server < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            continue;
+        }
+        pollfd p{server, POLLIN, 0};
+        if (poll(&p, 1, 200) <= 0)
+            continue;
+        int fd = accept(server, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        // the request itself doesn't matter, every path gets the metrics
+        char request[1024];
+        pollfd r{fd, POLLIN, 0};
+        if (poll(&r, 1, 1000) > 0)
+            (void)!read(fd, request, sizeof(request));
+        connection client(fd);
+        std::string text = metrics.text();
+        client.send("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: " + std::to_string(text.size()) + "\r\n\r\n" +
+                    text.substr(0, text.size() - 1));
+    }
+}
+
+// Read lines until the client disconnects or the daemon stops, done is
+// set on the way out so the thread can be joined
+void read_client(std::shared_ptr<connection> client,
+                 daemon_context& context,
+                 std::shared_ptr<std::atomic<bool>> done) {
+    std::string buffer;
+    char chunk[4096];
+    int line_number = 0;
+    while (!STOP) {
+        pollfd p{client->fd, POLLIN, 0};
+        if (poll(&p, 1, 200) <= 0)
+            continue;
+        ssize_t n = read(client->fd, chunk, sizeof(chunk));
+        if (n <= 0)
+            break;
+        buffer.append(chunk, n);
+        size_t end;
+        while ((end = buffer.find('\n')) != std::string::npos) {
+            handle_line(buffer.substr(0, end), ++line_number, client, context);
+            buffer.erase(0, end + 1);
+        }
+    }
+    if (!buffer.empty() && !STOP)
+        handle_line(buffer, ++line_number, client, context);
+    *done = true;
+}
+
+// A thread reading one client, the context has to outlive it so they are
+// joined before the daemon returns
+struct reader {
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool>> done;
+};
+
+int serve_socket(const std::string& path, daemon_context& context) {
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return 1;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        printf("Socket path is too long\n");
+        close(server);
+        return 1;
+    }
+    std::copy(path.begin(), path.end(), address.sun_path);
+    unlink(path.c_str());
+    if (bind(server, (sockaddr*)&address, sizeof(address)) < 0 || listen(server, 16) < 0) {
+        perror("bind");
+        close(server);
+        return 1;
+    }
+
+    std::vector<reader> readers;
+    while (!STOP) {
+        // clients which are gone don't keep their thread around
+        auto finished = std::partition(readers.begin(), readers.end(),
+                                       [](const reader& r) { return !*r.done; });
+        for (auto it = finished; it != readers.end(); ++it)
+            it->thread.join();
+        readers.erase(finished, readers.end());
+
+        pollfd p{server, POLLIN, 0};
+        if (poll(&p, 1, 200) <= 0)
+            continue;
+        int fd = accept(server, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        auto client = std::make_shared<connection>(fd);
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        readers.push_back(reader{std::thread(read_client, client, std::ref(context), done), done});
+    }
+
+    for (auto& r : readers)
+        r.thread.join();
+    close(server);
+    unlink(path.c_str());
+    return 0;
+}
+#endif
+
+}  // namespace
+
+int run_daemon(const daemon_options& options) {
+    STOP = 0;
+    int workers = std::max(options.workers, 1);
+    int threads = options.threads;
+    if (threads <= 0)
+        threads = default_thread_count();
+    // the workers share the processors
+    int threads_per_worker = std::max(threads / workers, 1);
+
+    job_queue queue;
+    daemon_metrics metrics;
+    solution_cache cache;
+    if (!options.cache.empty() && !cache.open(options.cache, options.cache_size)) {
+        printf("%s\n", cache.error().c_str());
+        return 1;
+    }
+    daemon_context context{queue, metrics, options.cache.empty() ? nullptr : &cache};
+    std::vector<std::thread> pool;
+    for (int i = 0; i < workers; i++)
+        pool.emplace_back(work, std::ref(context), threads_per_worker);
+
+#ifndef _WIN32
+    int metrics_server = -1;
+    if (!options.metrics.empty()) {
+        metrics_server = listen_metrics(options.metrics);
+        if (metrics_server < 0)
+            printf("Metrics can't be served on %s\n", options.metrics.c_str());
+    }
+    struct sigaction dump {};
+    dump.sa_handler = handle_dump;
+    sigaction(SIGUSR1, &dump, nullptr);
+    // both modes stop reading and answer what is queued, without
+    // SA_RESTART a blocked read of stdin returns as well
+    struct sigaction action {};
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::atomic<bool> done{false};
+    std::thread metrics_thread(serve_metrics, metrics_server, std::cref(metrics), std::cref(done));
+#endif
+
+    int code = 0;
+    if (options.socket_path.empty()) {
+        auto client = std::make_shared<connection>(-1);
+        std::string line;
+        int line_number = 0;
+        while (!STOP && std::getline(std::cin, line))
+            handle_line(line, ++line_number, client, context);
+    } else {
+#ifndef _WIN32
+        code = serve_socket(options.socket_path, context);
+#else
+        printf("Unix sockets are not supported, use stdin instead\n");
+        code = 1;
+#endif
+    }
+
+    // answer everything already queued before leaving
+    queue.close();
+    for (auto& t : pool)
+        t.join();
+#ifndef _WIN32
+    done = true;
+    metrics_thread.join();
+    if (metrics_server >= 0) {
+        close(metrics_server);
+        if (options.metrics.find_first_not_of("0123456789") != std::string::npos)
+            unlink(options.metrics.c_str());
+    }
+#endif
+    return code;
+}
+
+}  // namespace pazusoba
@@ -0,0 +1,502 @@
+// evaluate.cpp
+// Erasing and scoring a board without a solver, solver::evaluate() calls
+// this with its own profiles so both always agree.
+
+#include <pazusoba/core.h>
+#include <algorithm>
+
+namespace pazusoba {
+namespace {
+
+typedef unsigned long long int cell_bits;
+
+// One combo of an erasing pass, the cells are bits of the board
+struct erased_combo {
+    orb info;
+    int size;
+    cell_bits cells;
+};
+
+bool has(cell_bits cells, int i) {
+    return (cells >> i) & 1;
+}
+
+// Erase every combo once and return how many there were, the same as
+// solver::erase_combo() with fixed buffers
+int erase_pass(game_board& board, int rows, int columns, int min_erase, erased_combo* out) {
+    const int size = rows * columns;
+    cell_bits marked = 0;
+    for (int row = 0; row < rows; ++row) {
+        int col = 0;
+        while (col < columns) {
+            int start = col;
+            orb current = board[row * columns + col];
+            while (col < columns && board[row * columns + col] == current)
+                ++col;
+            if (current != 0 && col - start >= min_erase) {
+                for (int c = start; c < col; ++c)
+                    marked |= 1ULL << (row * columns + c);
+            }
+        }
+    }
+    for (int col = 0; col < columns; ++col) {
+        int row = 0;
+        while (row < rows) {
+            int start = row;
+            orb current = board[row * columns + col];
+            while (row < rows && board[row * columns + col] == current)
+                ++row;
+            if (current != 0 && row - start >= min_erase) {
+                for (int r = start; r < row; ++r)
+                    marked |= 1ULL << (r * columns + col);
+            }
+        }
+    }
+
+    int count = 0;
+    cell_bits visited = 0;
+    int queue[MAX_BOARD_LENGTH];
+    for (int start = 0; start < size; ++start) {
+        if (!has(marked, start) || has(visited, start))
+            continue;
+
+        orb current = board[start];
+        cell_bits cells = 0;
+        int head = 0;
+        int tail = 0;
+        queue[tail++] = start;
+        visited |= 1ULL << start;
+        while (head < tail) {
+            int loc = queue[head++];
+            cells |= 1ULL << loc;
+            int next[4] = {loc - columns, loc + columns, loc - 1, loc + 1};
+            bool inside[4] = {loc >= columns, loc + columns < size, loc % columns != 0,
+                              loc % columns != columns - 1};
+            for (int i = 0; i < 4; ++i) {
+                int n = next[i];
+                if (!inside[i] || !has(marked, n) || has(visited, n) || board[n] != current)
+                    continue;
+                visited |= 1ULL << n;
+                queue[tail++] = n;
+            }
+        }
+
+        if (tail >= min_erase) {
+            for (int i = 0; i < tail; ++i)
+                board[queue[i]] = 0;
+            out[count++] = {current, tail, cells};
+        }
+    }
+    return count;
+}
+
+void move_orbs_down(game_board& board, int rows, int columns) {
+    for (int col = 0; col < columns; ++col) {
+        int empty = -1;
+        for (int row = rows - 1; row >= 0; --row) {
+            orb o = board[row * columns + col];
+            if (o == 0) {
+                if (empty == -1)
+                    empty = row;
+            } else if (empty != -1) {
+                board[empty * columns + col] = o;
+                board[row * columns + col] = 0;
+                --empty;
+            }
+        }
+    }
+}
+
+// the cells are exactly the 3x3 square at their top left corner
+bool is_3x3_square(const erased_combo& c, int rows, int columns) {
+    if (c.size != 9)
+        return false;
+    int min_row = rows;
+    int min_col = columns;
+    for (int i = 0; i < rows * columns; ++i) {
+        if (has(c.cells, i)) {
+            min_row = std::min(min_row, i / columns);
+            min_col = std::min(min_col, i % columns);
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            if (min_row + i >= rows || min_col + j >= columns ||
+                !has(c.cells, (min_row + i) * columns + min_col + j))
+                return false;
+        }
+    }
+    return true;
+}
+
+// orbs of the combo in each column and row, offset by 2 so the lines next
+// to the edge can be looked up
+void count_lines(const erased_combo& c,
+                 int size,
+                 int columns,
+                 int* vertical,
+                 int* horizontal,
+                 int& big_column,
+                 int& big_row) {
+    big_column = -1;
+    big_row = -1;
+    for (int loc = 0; loc < size; ++loc) {
+        if (!has(c.cells, loc))
+            continue;
+        int x = loc % columns;
+        int y = loc / columns;
+        // only one line can have 3 of 5 orbs, for more the last one wins
+        if (++vertical[x + 2] >= 3)
+            big_column = x;
+        if (++horizontal[y + 2] >= 3)
+            big_row = y;
+    }
+}
+
+}  // namespace
+
+board_evaluation evaluate_board(const game_board& board,
+                                int rows,
+                                int columns,
+                                int min_erase,
+                                const evaluation_plan* plan) {
+    board_evaluation result;
+    const int size = rows * columns;
+    int score = 0;
+
+    orb_list counter{};
+    orb_distance distance[ORB_COUNT];
+    for (int i = 0; i < size; i++) {
+        auto o = board[i];
+        counter[o]++;
+        // 0 to 5 only for 6x5, 6 to 11 will convert to 0 to 5
+        int loc = i % columns;
+        if (loc > distance[o].max)
+            distance[o].max = loc;
+        else if (loc < distance[o].min)
+            distance[o].min = loc;
+    }
+    for (int i = 0; i < ORB_COUNT; i++)
+        score -= distance[i].max - distance[i].min;
+
+    auto adjacency_score = [&](const profile* p) {
+        int guide = 0;
+        for (int i = 0; i < size; i++) {
+            if (board[i] == 0)
+                continue;
+            int weight = 4;
+            if (p != nullptr && p->orbs[board[i]])
+                weight = 8;
+            if (i % columns != columns - 1 && board[i] == board[i + 1])
+                guide += weight;
+            if (i + columns < size && board[i] == board[i + columns])
+                guide += weight;
+        }
+        return std::min(guide, 200);
+    };
+
+    // every combo erases at least one orb
+    erased_combo combos[MAX_BOARD_LENGTH];
+    int combo = 0;
+    auto& copy = result.board;
+    copy = board;
+    while (true) {
+        int found = erase_pass(copy, rows, columns, min_erase, combos + combo);
+        if (found == 0)
+            break;
+        combo += found;
+        result.rounds++;
+        move_orbs_down(copy, rows, columns);
+    }
+
+    result.combo = combo;
+    for (int i = 0; i < combo; i++) {
+        result.colour_combo[combos[i].info]++;
+        result.erased[combos[i].info] += combos[i].size;
+    }
+    for (int i = 0; i < size; i++) {
+        if (copy[i] > 0)
+            result.remaining++;
+    }
+
+    const int count = plan == nullptr ? 0 : plan->count;
+    const int goal_count = plan == nullptr ? 0 : plan->verdicts ? plan->goal_count : count;
+    const int step = plan == nullptr ? 0 : plan->step;
+    const auto& colour_counter = result.colour_combo;
+    // track if all goals are reached
+    int goal = 0;
+    for (int i = 0; i < count; i++) {
+        const auto& profile = plan->profiles[i];
+        profile_verdict verdict;
+        if (plan->verdicts != nullptr) {
+            verdict = plan->verdicts[i];
+        } else {
+            verdict.target = profile.target;
+            verdict.colour_target = profile.colour_target;
+        }
+
+        switch (profile.name) {
+            case target_combo: {
+                int target = verdict.target;
+                int colour_target = verdict.colour_target;
+                int preferred_combo = 0;
+                for (int j = 0; j < combo; j++) {
+                    if (profile.orbs[combos[j].info])
+                        preferred_combo++;
+                }
+                int guide = adjacency_score(&profile);
+                if (target == -1) {
+                    // max combo
+                    score += combo * 1000 + guide - step;
+                    if (colour_target <= 0) {
+                        score += preferred_combo * 300;
+                    } else {
+                        int lack = colour_target - preferred_combo;
+                        if (lack > 0)
+                            score -= lack * 1500;
+                        else
+                            score += preferred_combo * 300;
+                    }
+                    int max_combo = plan->max_combo > 0
+                                        ? plan->max_combo
+                                        : estimate_max_combo(counter, rows, columns, min_erase);
+                    // a packing short of the counting bound may not be
+                    // the real max so it never ends the search
+                    if (combo >= max_combo &&
+                        max_combo == count_max_combo(counter, min_erase) &&
+                        (colour_target <= 0 || preferred_combo >= colour_target))
+                        goal++;
+                } else {
+                    // only do max target combo
+                    if (combo < target)
+                        score -= (target - combo) * 1000;
+                    if (combo == target)
+                        score += combo * 1000 + guide - step;
+                    else if (target > 7)
+                        score -= 500;
+
+                    if (colour_target <= 0) {
+                        score += preferred_combo * 300;
+                    } else {
+                        int lack = colour_target - preferred_combo;
+                        if (lack > 0)
+                            score -= lack * 1500;
+                        else
+                            score += preferred_combo * 300;
+                    }
+
+                    if (combo == target &&
+                        (colour_target <= 0 || preferred_combo >= colour_target))
+                        goal++;
+                }
+            } break;
+
+            case colour: {
+                bool has_all_target_colours = verdict.feasible || verdict.relaxed;
+                for (int j = 0; j < ORB_COUNT; j++) {
+                    // this orb should be included, unless it can never be erased
+                    if (profile.orbs[j] && counter[j] >= min_erase) {
+                        // just add a tiny score, don't do too much
+                        if (colour_counter[j] == 0)
+                            has_all_target_colours = false;
+                        else
+                            score += 2;
+                    }
+                }
+
+                if (has_all_target_colours)
+                    goal++;
+            } break;
+
+            case colour_combo: {
+                bool fulfilled = verdict.feasible || verdict.relaxed;
+                for (int j = 0; j < ORB_COUNT; j++) {
+                    // this orb should be included, unless it can never be erased
+                    if (profile.orbs[j] && counter[j] >= min_erase) {
+                        int colour_combo = colour_counter[j];
+                        // just add a tiny score, don't do too much
+                        if (colour_combo == 0)
+                            fulfilled = false;
+                        else if (colour_combo >= verdict.target)
+                            score += 2;
+                    }
+                }
+
+                if (fulfilled)
+                    goal++;
+            } break;
+
+            case connected_orb: {
+                int target = verdict.target;
+                bool fulfilled = false;
+                bool has_orb_filter = false;
+                for (int j = 0; j < ORB_COUNT; ++j) {
+                    if (profile.orbs[j]) {
+                        has_orb_filter = true;
+                        break;
+                    }
+                }
+
+                for (int j = 0; j < combo; j++) {
+                    const auto& c = combos[j];
+                    if (has_orb_filter && !profile.orbs[c.info])
+                        continue;
+                    int connected_count = c.size;
+                    if (counter[c.info] >= target) {
+                        if (connected_count < target) {
+                            score += (connected_count - min_erase) * 10;
+                        } else if (connected_count == target) {
+                            fulfilled = true;
+                            score += 100;
+                        } else {
+                            score -= (connected_count - target) * 50;
+                        }
+                    }
+                }
+
+                score += combo * 20;
+                if (fulfilled) {
+                    score += 20000;
+                    goal++;
+                }
+            } break;
+
+            case orb_remaining: {
+                if (result.remaining <= verdict.target)
+                    goal++;
+                score -= result.remaining * 10;
+            } break;
+
+            case shape_L: {
+                for (int j = 0; j < combo; j++) {
+                    const auto& c = combos[j];
+                    if (!profile.orbs[c.info] || counter[c.info] < 5)
+                        continue;
+                    if (c.size == 5) {
+                        // some score for connecting more orbs
+                        // check if it is L shape
+                        int vertical[MAX_BOARD_LENGTH + 4]{0};
+                        int horizontal[MAX_BOARD_LENGTH + 4]{0};
+                        int big_column, big_row;
+                        count_lines(c, size, columns, vertical, horizontal, big_column,
+                                    big_row);
+
+                        // This is the corner
+                        if (big_column > -1 && big_row > -1) {
+                            int corner = 0;
+                            // Check if big_column -2 or +2 exists
+                            if (vertical[big_column] > 0 || vertical[big_column + 4] > 0)
+                                corner++;
+                            // Same for big_row
+                            if (horizontal[big_row] > 0 || horizontal[big_row + 4] > 0)
+                                corner++;
+
+                            if (corner == 2)
+                                score += 50;
+                        }
+                    } else if (c.size > 3) {
+                        score += 10;
+                    }
+                }
+
+                // consider combo here as well
+                score += combo * 20;
+            } break;
+
+            case shape_plus: {
+                for (int j = 0; j < combo; j++) {
+                    const auto& c = combos[j];
+                    if (!profile.orbs[c.info] || counter[c.info] < 5)
+                        continue;
+                    if (c.size <= 5)
+                        score += (c.size - min_erase) * 10;
+
+                    // some score for connecting more orbs
+                    int vertical[MAX_BOARD_LENGTH + 4]{0};
+                    int horizontal[MAX_BOARD_LENGTH + 4]{0};
+                    int big_column, big_row;
+                    count_lines(c, size, columns, vertical, horizontal, big_column, big_row);
+
+                    // This is the center point
+                    if (big_column > -1 && big_row > -1) {
+                        int center = 0;
+                        // Check up down left right there is an orb around
+                        // center orb
+                        if (vertical[big_column + 1] > 0 && vertical[big_column + 3] > 0)
+                            center++;
+                        if (horizontal[big_row + 1] > 0 && horizontal[big_row + 3] > 0)
+                            center++;
+
+                        if (center == 2)
+                            score += 50;
+                        if (center == 1)
+                            score += 10;
+                    }
+                }
+            } break;
+
+            case shape_square: {
+                // a 3x3 square beats everything else
+                bool found_3x3 = false;
+                for (int j = 0; j < combo; j++) {
+                    const auto& c = combos[j];
+                    if (profile.orbs[c.info] && counter[c.info] >= 9 &&
+                        is_3x3_square(c, rows, columns)) {
+                        score += 50000;
+                        goal++;
+                        found_3x3 = true;
+                    }
+                }
+
+                // nothing else is scored once there is one
+                if (found_3x3) {
+                    result.score = score;
+                    result.goal = goal > 0;
+                    return result;
+                }
+
+                // clusters of 6 or more orbs could become a square
+                for (int j = 0; j < combo; j++) {
+                    if (counter[combos[j].info] >= 9 && combos[j].size >= 6)
+                        score += combos[j].size * 20;
+                }
+
+                // how close every 3x3 area is to a square of each colour
+                for (int orb_type = 1; orb_type < ORB_COUNT; orb_type++) {
+                    if (counter[orb_type] < 9)
+                        continue;
+                    for (int top_row = 0; top_row <= rows - 3; top_row++) {
+                        for (int top_col = 0; top_col <= columns - 3; top_col++) {
+                            int matching_orbs = 0;
+                            for (int r = 0; r < 3; r++) {
+                                for (int c = 0; c < 3; c++) {
+                                    if (copy[(top_row + r) * columns + top_col + c] == orb_type)
+                                        matching_orbs++;
+                                }
+                            }
+
+                            if (matching_orbs >= 6)
+                                score += 1000;
+                            else if (matching_orbs >= 4)
+                                score += 200;
+                            else if (matching_orbs >= 2)
+                                score += 50;
+                        }
+                    }
+                }
+            } break;
+
+            // the constructive solver handles these, see shape.h
+            case shape_row:
+            case shape_column:
+            default:
+                break;
+        }
+    }
+
+    result.score = score;
+    result.goal = goal == goal_count && (count == 0 || goal_count > 0);
+    return result;
+}
+
+}  // namespace pazusoba
@@ -0,0 +1,321 @@
+// max_combo.cpp
+// Find the max combo of a board by packing combos of every colour into it.
+//
+// Orbs can be rearranged freely so only the colour distribution, the board
+// size and min erase matter. Each combo is placed as a solid rectangle with at
+// least one side as long as min erase, combos of the same colour never touch
+// and the rest of the orbs are placed so that they never line up. The most
+// combos such a packing can have is verified to be reachable and it is exact
+// whenever it reaches the counting bound, count / min erase for every colour.
+
+#include <pazusoba/pazusoba.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace pazusoba {
+namespace {
+
+// give up after trying this many placements for one combo count
+const long long MAX_PACKING_NODES = 50000;
+
+class combo_packer {
+    int row;
+    int column;
+    int size;
+    int min_erase;
+    int target = 0;
+    std::vector<int> remaining;
+    // (height, width) of every combo shape, smaller ones first
+    std::vector<std::pair<int, int>> shapes;
+    // colours sorted by orbs left, one slice for each cell so that nothing
+    // is allocated while searching
+    std::vector<int> orders;
+    // colour index for every cell, -1 when it is still empty
+    int colour_of[MAX_BOARD_LENGTH];
+    // combo index for every cell, -1 for orbs that are not erased
+    int combo_of[MAX_BOARD_LENGTH];
+    int placed = 0;
+    long long nodes = 0;
+
+    int run_length(int pos, int step_row, int step_col) const {
+        int r = pos / column;
+        int c = pos % column;
+        int colour = colour_of[pos];
+        int length = 1;
+        for (int sign = -1; sign <= 1; sign += 2) {
+            int nr = r + sign * step_row;
+            int nc = c + sign * step_col;
+            while (nr >= 0 && nr < row && nc >= 0 && nc < column &&
+                   colour_of[nr * column + nc] == colour) {
+                length++;
+                nr += sign * step_row;
+                nc += sign * step_col;
+            }
+        }
+        return length;
+    }
+
+    // orbs that are not erased can't be part of any line
+    bool filler_ok(int pos) const {
+        return run_length(pos, 0, 1) < min_erase &&
+               run_length(pos, 1, 0) < min_erase;
+    }
+
+    bool place_combo(int pos, int height, int width, int colour) {
+        int top = pos / column;
+        int left = pos % column;
+        if (top + height > row || left + width > column)
+            return false;
+        for (int r = top; r < top + height; r++) {
+            for (int c = left; c < left + width; c++) {
+                if (colour_of[r * column + c] >= 0)
+                    return false;
+            }
+        }
+
+        for (int r = top; r < top + height; r++) {
+            for (int c = left; c < left + width; c++) {
+                colour_of[r * column + c] = colour;
+                combo_of[r * column + c] = placed;
+            }
+        }
+
+        // combos of the same colour would merge and orbs left around can't
+        // extend the combo into a line
+        bool ok = true;
+        for (int r = top - 1; r <= top + height && ok; r++) {
+            for (int c = left - 1; c <= left + width; c++) {
+                bool corner = (r == top - 1 || r == top + height) &&
+                              (c == left - 1 || c == left + width);
+                bool inside = r >= top && r < top + height && c >= left &&
+                              c < left + width;
+                if (corner || inside || r < 0 || r >= row || c < 0 || c >= column)
+                    continue;
+                int next = r * column + c;
+                if (colour_of[next] != colour)
+                    continue;
+                if (combo_of[next] >= 0 || !filler_ok(next)) {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        if (!ok) {
+            remove_combo(pos, height, width);
+            return false;
+        }
+        remaining[colour] -= height * width;
+        placed++;
+        return true;
+    }
+
+    void remove_combo(int pos, int height, int width) {
+        int top = pos / column;
+        int left = pos % column;
+        for (int r = top; r < top + height; r++) {
+            for (int c = left; c < left + width; c++) {
+                colour_of[r * column + c] = -1;
+                combo_of[r * column + c] = -1;
+            }
+        }
+    }
+
+    bool search(int pos) {
+        while (pos < size && colour_of[pos] >= 0)
+            pos++;
+        if (pos == size)
+            return placed >= target;
+        if (++nodes > MAX_PACKING_NODES) {
+            aborted = true;
+            return false;
+        }
+
+        int possible = placed;
+        for (int count : remaining)
+            possible += count / min_erase;
+        if (possible < target)
+            return false;
+
+        // colours with more orbs left are placed first
+        int colour_count = remaining.size();
+        int* order = orders.data() + pos * colour_count;
+        int* order_end = order + colour_count;
+        for (int i = 0; i < colour_count; i++)
+            order[i] = i;
+        std::sort(order, order_end, [this](int a, int b) {
+            return remaining[a] > remaining[b];
+        });
+
+        if (placed < target) {
+            for (const int* it = order; it != order_end; ++it) {
+                int colour = *it;
+                if (remaining[colour] < min_erase)
+                    continue;
+                for (const auto& shape : shapes) {
+                    int height = shape.first;
+                    int width = shape.second;
+                    if (height * width > remaining[colour])
+                        continue;
+                    if (!place_combo(pos, height, width, colour))
+                        continue;
+                    if (search(pos + 1))
+                        return true;
+                    remove_combo(pos, height, width);
+                    remaining[colour] += height * width;
+                    placed--;
+                    if (aborted)
+                        return false;
+                }
+            }
+        }
+
+        for (const int* it = order; it != order_end; ++it) {
+            int colour = *it;
+            if (remaining[colour] == 0)
+                continue;
+            colour_of[pos] = colour;
+            remaining[colour]--;
+            if (filler_ok(pos) && search(pos + 1))
+                return true;
+            colour_of[pos] = -1;
+            remaining[colour]++;
+            if (aborted)
+                return false;
+        }
+        return false;
+    }
+
+public:
+    bool aborted = false;
+
+    combo_packer(int row, int column, int min_erase, const std::vector<int>& counts)
+        : row(row),
+          column(column),
+          size(row * column),
+          min_erase(min_erase),
+          remaining(counts),
+          orders(size * counts.size()) {
+        for (int height = 1; height <= row; height++) {
+            for (int width = 1; width <= column; width++) {
+                if (height >= min_erase || width >= min_erase)
+                    shapes.push_back(std::make_pair(height, width));
+            }
+        }
+        std::stable_sort(shapes.begin(), shapes.end(),
+                         [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+                             return a.first * a.second < b.first * b.second;
+                         });
+    }
+
+    // true if the orbs can be arranged into at least target combos, false
+    // if they can't or the search gave up, see aborted
+    bool pack(int combo) {
+        std::fill(colour_of, colour_of + MAX_BOARD_LENGTH, -1);
+        std::fill(combo_of, combo_of + MAX_BOARD_LENGTH, -1);
+        placed = 0;
+        nodes = 0;
+        aborted = false;
+        target = combo;
+        return search(0);
+    }
+};
+
+std::mutex max_combo_mutex;
+// (row, column, min erase, sorted counts) -> max combo, 0 if unknown
+std::map<std::vector<int>, int> max_combo_cache;
+
+}  // namespace
+
+int count_max_combo(const orb_list& counter, const int min_erase) {
+    int bound = 0;
+    for (int i = 1; i < ORB_COUNT; i++)
+        bound += counter[i] / min_erase;
+    return bound;
+}
+
+int pack_max_combo(const orb_list& counter,
+                   const int row,
+                   const int column,
+                   const int min_erase) {
+    std::vector<int> counts;
+    int total = counter[0];
+    int bound = count_max_combo(counter, min_erase);
+    for (int i = 1; i < ORB_COUNT; i++) {
+        if (counter[i] == 0)
+            continue;
+        counts.push_back(counter[i]);
+        total += counter[i];
+    }
+    if (total != row * column || bound == 0)
+        return 0;
+
+    // only the distribution matters so colours can be sorted
+    std::sort(counts.begin(), counts.end());
+    std::vector<int> key{row, column, min_erase, counter[0]};
+    key.insert(key.end(), counts.begin(), counts.end());
+    {
+        std::lock_guard<std::mutex> lock(max_combo_mutex);
+        auto it = max_combo_cache.find(key);
+        if (it != max_combo_cache.end())
+            return it->second;
+    }
+
+    // every empty cell is a colour of its own so it can never be erased
+    for (int i = 0; i < counter[0]; i++)
+        counts.push_back(1);
+
+    int result = 0;
+    combo_packer packer(row, column, min_erase, counts);
+    for (int combo = bound; combo > 0; combo--) {
+        if (packer.pack(combo)) {
+            result = combo;
+            break;
+        }
+        // more combos have been ruled out but this count is unknown, it is
+        // only an upper bound so it isn't cached
+        if (packer.aborted)
+            return combo;
+    }
+
+    std::lock_guard<std::mutex> lock(max_combo_mutex);
+    max_combo_cache[key] = result;
+    return result;
+}
+
+int estimate_max_combo(const orb_list& counter,
+                       const int row,
+                       const int column,
+                       const int min_erase) {
+    int packed = pack_max_combo(counter, row, column, min_erase);
+    if (packed > 0)
+        return packed;
+
+    int size = row * column;
+    // at least one combo when the board has only one orb
+    int max_combo = 0;
+    int threshold = size / 2;
+    for (const auto& count : counter) {
+        int combo = count / min_erase;
+        // based on my experience, it is not possible to do more combo
+        // if one colour has more than half the board
+        // the max combo needs to be reduced by 2 times
+        // RRRRRRRRRRRRRRRRRRRRRRRRGGGBBB can do max 4 combos naively
+        // this is because R is taking up too much spaces
+        // MAX_COMBO might not be 100% correct but it's a good reference
+        if (count > threshold) {
+            int extra_combo = (count - threshold) * 2 / min_erase;
+            combo -= extra_combo;
+        }
+        max_combo += combo;
+    }
+
+    if (max_combo == 0)
+        return 1;
+    return max_combo;
+}
+
+}  // namespace pazusoba
@@ -0,0 +1,132 @@
+// metrics.cpp
+// What the daemon has been doing, in the Prometheus text format so it can
+// be scraped or dumped and compared between versions.
+
+#include <pazusoba/core.h>
+#include <cstdarg>
+#include <cstdio>
+
+namespace pazusoba {
+namespace {
+
+const char* SIZE_LABELS[] = {"4x5", "5x6", "6x7"};
+
+int size_index(const std::string& board) {
+    if (board.size() == 20)
+        return 0;
+    if (board.size() == 30)
+        return 1;
+    return 2;
+}
+
+void append(std::string& text, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    text += line;
+}
+
+}  // namespace
+
+void latency_histogram::record(long long int micros) {
+    COUNT.fetch_add(1, std::memory_order_relaxed);
+    SUM.fetch_add(micros, std::memory_order_relaxed);
+    if (micros > bound(BUCKET_COUNT - 1))
+        return;
+
+    int index = 0;
+    if (micros > (1LL << MIN_SHIFT)) {
+        // the power of two it falls in, then the linear part of it
+        int shift = bits::highest(micros - 1);
+        long long int base = 1LL << shift;
+        int sub = (micros - 1 - base) * SUB_BUCKETS / base;
+        index = (shift - MIN_SHIFT) * SUB_BUCKETS + sub + 1;
+    }
+    BUCKETS[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+long long int latency_histogram::bound(int index) {
+    if (index == 0)
+        return 1LL << MIN_SHIFT;
+    int shift = MIN_SHIFT + (index - 1) / SUB_BUCKETS;
+    int sub = (index - 1) % SUB_BUCKETS + 1;
+    long long int base = 1LL << shift;
+    return base + base * sub / SUB_BUCKETS;
+}
+
+void daemon_metrics::solved(const solve_request& request, const solve_response& response) {
+    SOLVED++;
+    if (response.timed_out)
+        TIMEOUTS++;
+    if (response.cached)
+        CACHE_HITS++;
+    if (response.depth > 0) {
+        // expanded states for every depth compared to the beam size
+        double occupancy = (double)response.expanded / response.depth / request.beam_size;
+        OCCUPANCY += (long long int)(occupancy * 1000000);
+    }
+    VISITED += response.visited;
+    DUPLICATES += response.duplicates;
+    LATENCY[size_index(request.board)].record((long long int)(response.ms * 1000));
+}
+
+std::string daemon_metrics::text() const {
+    std::string text;
+    double uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - START).count();
+    long long int solved = SOLVED.load();
+
+    append(text, "# HELP pazusoba_uptime_seconds Seconds since the daemon started\n");
+    append(text, "# TYPE pazusoba_uptime_seconds gauge\n");
+    append(text, "pazusoba_uptime_seconds %.3f\n", uptime);
+    append(text, "# HELP pazusoba_requests_total Request lines received\n");
+    append(text, "# TYPE pazusoba_requests_total counter\n");
+    append(text, "pazusoba_requests_total %lld\n", REQUESTS.load());
+    append(text, "# HELP pazusoba_rejected_total Request lines which couldn't be parsed\n");
+    append(text, "# TYPE pazusoba_rejected_total counter\n");
+    append(text, "pazusoba_rejected_total %lld\n", REJECTED.load());
+    append(text, "# HELP pazusoba_solved_total Requests answered with a route\n");
+    append(text, "# TYPE pazusoba_solved_total counter\n");
+    append(text, "pazusoba_solved_total %lld\n", solved);
+    append(text, "# HELP pazusoba_timeouts_total Searches stopped by their deadline\n");
+    append(text, "# TYPE pazusoba_timeouts_total counter\n");
+    append(text, "pazusoba_timeouts_total %lld\n", TIMEOUTS.load());
+    append(text, "# HELP pazusoba_cache_hits_total Requests answered by the solution cache\n");
+    append(text, "# TYPE pazusoba_cache_hits_total counter\n");
+    append(text, "pazusoba_cache_hits_total %lld\n", CACHE_HITS.load());
+    append(text, "# HELP pazusoba_queue_depth Requests waiting for a worker\n");
+    append(text, "# TYPE pazusoba_queue_depth gauge\n");
+    append(text, "pazusoba_queue_depth %d\n", QUEUED.load());
+    append(text, "# HELP pazusoba_beam_occupancy Expanded states per depth over the beam size, averaged\n");
+    append(text, "# TYPE pazusoba_beam_occupancy gauge\n");
+    append(text, "pazusoba_beam_occupancy %.6f\n",
+           solved > 0 ? OCCUPANCY.load() / 1000000.0 / solved : 0.0);
+    append(text, "# HELP pazusoba_visited_total States checked against the visited set\n");
+    append(text, "# TYPE pazusoba_visited_total counter\n");
+    append(text, "pazusoba_visited_total %lld\n", VISITED.load());
+    append(text, "# HELP pazusoba_visited_hits_total States dropped as already visited\n");
+    append(text, "# TYPE pazusoba_visited_hits_total counter\n");
+    append(text, "pazusoba_visited_hits_total %lld\n", DUPLICATES.load());
+
+    append(text, "# HELP pazusoba_solve_seconds Time to answer a request by board size\n");
+    append(text, "# TYPE pazusoba_solve_seconds histogram\n");
+    for (int size = 0; size < SIZE_COUNT; size++) {
+        const auto& latency = LATENCY[size];
+        long long int cumulative = 0;
+        for (int i = 0; i < latency_histogram::BUCKET_COUNT; i++) {
+            cumulative += latency.bucket(i);
+            append(text, "pazusoba_solve_seconds_bucket{size=\"%s\",le=\"%g\"} %lld\n",
+                   SIZE_LABELS[size], latency_histogram::bound(i) / 1e6, cumulative);
+        }
+        append(text, "pazusoba_solve_seconds_bucket{size=\"%s\",le=\"+Inf\"} %lld\n",
+               SIZE_LABELS[size], latency.count());
+        append(text, "pazusoba_solve_seconds_sum{size=\"%s\"} %g\n", SIZE_LABELS[size],
+               latency.sum() / 1e6);
+        append(text, "pazusoba_solve_seconds_count{size=\"%s\"} %lld\n", SIZE_LABELS[size],
+               latency.count());
+    }
+    return text;
+}
+
+}  // namespace pazusoba
@@ -10,7 +10,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <map>
+#include <memory>
 #include <queue>
 #include <sstream>
 #include <thread>
@@ -21,11 +21,24 @@ state solver::adventure() {
     int REAL_BEAM_SIZE = BEAM_SIZE * 1.4;
     int max_children = ALLOW_DIAGONAL ? DIRECTION_COUNT : 4;
     VISITED.clear();
+    PRUNED_COUNT = 0;
+    VISITED_COUNT = 0;
+    DUPLICATE_COUNT = 0;
+    SAVED_STEPS = 0;
+    COMMITTED_START = false;
+    COMMITTED = state();
+    CACHE_HIT = false;
+    // buffers and threads are reused if the workspace is given
+    std::unique_ptr<workspace> own_workspace;
+    if (!WORKSPACE)
+        own_workspace.reset(new workspace());
+    workspace& space = WORKSPACE ? *WORKSPACE : *own_workspace;
     // setup the state, non blocking
-    std::vector<state> look;
+    std::vector<state>& look = space.look;
+    look.clear();
     look.reserve(REAL_BEAM_SIZE);
     // insert to temp, sort and copy back to look
-    std::vector<state> temp;
+    std::vector<state>& temp = space.temp;
     temp.resize(REAL_BEAM_SIZE * max_children);
     // TODO: using array can definitely things a lot because the vector needs to
     // write a lot of useless data before using it, reverse is better but the
@@ -33,6 +46,8 @@ state solver::adventure() {
 
     state best_state;
     bool found_max_combo = false;
+    // the best distinct states for refine()
+    std::vector<state> candidates;
 
     // assign all possible states to look
     for (int i = 0; i < BOARD_SIZE; ++i) {
@@ -47,16 +62,33 @@ state solver::adventure() {
     }
 
     // setup threading
-    int processor_count = std::thread::hardware_concurrency();
-    if (processor_count <= 0)
-        processor_count = 1;
+    int processor_count = thread_count();
     // unsigned int processor_count = 1;
-    std::vector<std::thread> threads;
-    threads.reserve(processor_count);
 
     int stop_count = 0;
 
+    if (PROGRESS)
+        PROGRESS->reset();
+
+    // no profile can be fulfilled by this board, don't search blindly
+    if (!feasible()) {
+        DEBUG_PRINT("No profile can be fulfilled, skip searching\n");
+        if (PROGRESS)
+            PROGRESS->finish();
+        return best_state;
+    }
+
+    if (CACHE && load_cached(best_state)) {
+        CACHE_HIT = true;
+        if (PROGRESS) {
+            PROGRESS->publish(0, best_state.combo, best_state.score);
+            PROGRESS->finish();
+        }
+        return best_state;
+    }
+
     // beam search with openmp
+    bool cancelled = false;
     for (int i = 0; i < SEARCH_DEPTH; i++) {
         if (found_max_combo)
             break;
@@ -66,34 +98,57 @@ state solver::adventure() {
         int look_size_thread = look_size / processor_count;
         for (auto& s : temp)
             s.score = MIN_STATE_SCORE;
+        // threads only read the best score of the previous depth
+        int best_score = best_state.score;
+        std::vector<int> pruned(processor_count, 0);
 
         // #pragma omp parallel for
-        for (int thread_num = 0; thread_num < processor_count; thread_num++) {
-            threads.emplace_back([&, thread_num, look_size_thread] {
-                int start_index = thread_num * (look_size_thread);
-                int end_index = (thread_num == processor_count - 1)
-                                    ? look_size
-                                    : start_index + look_size_thread;
-                for (int j = start_index; j < end_index; j++) {
-                    if (found_max_combo)
-                        continue;  // early stop
-
-                    const state& curr = look[j];
-
-                    if (curr.goal) {
-                        best_state = curr;
-                        found_max_combo = true;
-                        continue;
-                    }
+        space.pool.run(processor_count, [&, look_size_thread](int thread_num) {
+            int start_index = thread_num * (look_size_thread);
+            int end_index = (thread_num == processor_count - 1)
+                                ? look_size
+                                : start_index + look_size_thread;
+            int expanded = 0;
+            for (int j = start_index; j < end_index; j++) {
+                if (found_max_combo)
+                    continue;  // early stop
+
+                // check if it is cancelled once in a while
+                if (PROGRESS && (j - start_index) % PROGRESS_CHUNK == 0 &&
+                    j > start_index) {
+                    PROGRESS->add_expanded(expanded);
+                    expanded = 0;
+                    if (PROGRESS->cancelled())
+                        break;
+                }
+
+                const state& curr = look[j];
 
-                    expand(curr.board, curr, temp, j);
+                if (curr.goal) {
+                    best_state = curr;
+                    found_max_combo = true;
+                    continue;
                 }
-            });
-        }
 
-        for (auto& t : threads)
-            t.join();
-        threads.clear();
+                // its children can never replace the best state
+                if (PRUNING && can_prune(curr, best_score)) {
+                    pruned[thread_num]++;
+                    continue;
+                }
+
+                expand(curr.board, curr, temp, j);
+                expanded++;
+            }
+            if (PROGRESS)
+                PROGRESS->add_expanded(expanded);
+        });
+        for (int count : pruned)
+            PRUNED_COUNT += count;
+
+        // the states of this depth are incomplete, they are still sorted so
+        // the best one so far is kept
+        if (PROGRESS && PROGRESS->cancelled())
+            cancelled = true;
 
         // break out as soon as max combo or target is found
         // TODO: this should be the target
@@ -123,7 +178,9 @@ state solver::adventure() {
         int index = 0;
         for (int j = 0; j < REAL_BEAM_SIZE; j++, index++) {
             const auto& curr = temp[j];
+            VISITED_COUNT++;
             if (VISITED.find(curr.hash) != VISITED.end()) {
+                DUPLICATE_COUNT++;
                 index--;
             } else {
                 VISITED.insert(curr.hash);
@@ -136,10 +193,41 @@ state solver::adventure() {
                 if (curr.score == MIN_STATE_SCORE) {
                     break;
                 }
+                if (REFINE_DEPTH > 0 &&
+                    ((int)candidates.size() < REFINE_CANDIDATES ||
+                     curr.score > candidates.back().score)) {
+                    if ((int)candidates.size() == REFINE_CANDIDATES)
+                        candidates.pop_back();
+                    auto pos = std::upper_bound(candidates.begin(),
+                                                candidates.end(), curr,
+                                                std::greater<state>());
+                    candidates.insert(pos, curr);
+                }
                 look.push_back(curr);
             }
         }
 
+        // every state has been pruned, nothing is left to explore
+        if (look.empty())
+            break;
+
+        // later depths only follow the committed prefix
+        if (COMMIT_RATIO > 0 && commit_prefix(look)) {
+            if (!follows_commit(best_state))
+                best_state = look.front();
+            candidates.erase(
+                std::remove_if(candidates.begin(), candidates.end(),
+                               [this](const state& s) { return !follows_commit(s); }),
+                candidates.end());
+            if (COMMIT_CALLBACK)
+                COMMIT_CALLBACK(COMMITTED);
+        }
+
+        if (PROGRESS)
+            PROGRESS->publish(i + 1, best_state.combo, best_state.score);
+        if (cancelled)
+            break;
+
         // std::copy(begin, begin + (end - begin) / 3, look.begin());
         stop_count++;
         if (stop_count > STOP_THRESHOLD) {
@@ -147,6 +235,24 @@ state solver::adventure() {
         }
     }
 
+    if (REFINE_DEPTH > 0 && best_state.step > 0 && !cancelled) {
+        // a goal state is returned before it gets into the beam
+        if (found_max_combo)
+            candidates.insert(candidates.begin(), best_state);
+        best_state = refine(candidates);
+    }
+    if (SHORTEN && best_state.step > 0 && !cancelled)
+        best_state = shorten(best_state);
+    // a cancelled search isn't what the same search would find next time
+    if (CACHE && best_state.step > 0 && !cancelled)
+        store_cached(best_state);
+    if (PROGRESS) {
+        // refining and shortening may change the best state
+        PROGRESS->publish(PROGRESS->snapshot().depth, best_state.combo,
+                          best_state.score);
+        PROGRESS->finish();
+    }
+
     // print_state(best_state);
     return best_state;
 }  // namespace pazusoba
@@ -244,430 +350,17 @@ void solver::expand(const game_board& board,
 }
 
 void solver::evaluate(game_board& board, state& new_state) {
-    int score = 0;
-    // TODO: should this be after??
-    // scan the board to get the distance between each orb
-    orb_distance distance[ORB_COUNT];
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        auto& orb = board[i];
-        // 0 to 5 only for 6x5, 6 to 11 will convert to 0 to 5
-        int loc = i % COLUMN;
-        if (loc > distance[orb].max)
-            distance[orb].max = loc;
-        else if (loc < distance[orb].min)
-            distance[orb].min = loc;
-    }
-
-    for (int i = 0; i < ORB_COUNT; i++) {
-        auto& dist = distance[i];
-        score -= (dist.max - dist.min);
-    }
-
-    auto adjacency_score = [&](const profile* p) {
-        int guide = 0;
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            if (board[i] == 0)
-                continue;
-            int weight = 4;
-            if (p != nullptr && p->orbs[board[i]])
-                weight = 8;
-            if (i % COLUMN != COLUMN - 1 && board[i] == board[i + 1])
-                guide += weight;
-            if (i + COLUMN < BOARD_SIZE && board[i] == board[i + COLUMN])
-                guide += weight;
-        }
-        return std::min(guide, 200);
-    };
-
-    // erase the board and find out the combo number
-    combo_list list;  // TODO: 515ms here, destructor is slow
-    combo_list all_list;
-
-    int combo = 0;
-    int move_count = 0;
-    game_board copy = board;
-    game_board prev_board = board;  // 用于检测棋盘状态是否重复
-    const int MAX_ELIMINATION_ROUNDS = 20;  // 防止无限循环的保护机制
-
-    DEBUG_PRINT("=== Starting combo elimination loop ===\n");
-
-    while (move_count < MAX_ELIMINATION_ROUNDS) {
-        DEBUG_PRINT("Elimination round %d:\n", move_count + 1);
-        list.clear();  // 确保列表在每次调用前是空的
-        erase_combo(copy, list);
-        int combo_count = list.size();
-        DEBUG_PRINT("Combo count this round: %d\n", combo_count);
-
-        // Check if there are more combo
-        if (combo_count > 0) {
-            combo += combo_count;
-            all_list.insert(all_list.end(), list.begin(), list.end());
-            DEBUG_PRINT("Current combo count: %d\n", combo);
-
-            // 保存当前棋盘状态
-            prev_board = copy;
-            move_orbs_down(copy);
-
-            // 检测棋盘状态是否重复（死循环检测）
-            bool board_unchanged = true;
-            for (int i = 0; i < BOARD_SIZE; i++) {
-                if (copy[i] != prev_board[i]) {
-                    board_unchanged = false;
-                    break;
-                }
-            }
-
-            if (board_unchanged) {
-                DEBUG_PRINT("WARNING: Board state unchanged after move_orbs_down, breaking to prevent infinite loop\n");
-                break;
-            }
-
-            move_count++;
-            DEBUG_PRINT("Move count: %d\n", move_count);
-        } else {
-            DEBUG_PRINT("No new combos, breaking loop\n");
-            break;
-        }
-    }
-
-    if (move_count >= MAX_ELIMINATION_ROUNDS) {
-        DEBUG_PRINT("WARNING: Maximum elimination rounds reached, breaking to prevent infinite loop\n");
-    }
-
-    DEBUG_PRINT("Final combo count: %d, Total rounds: %d\n", combo, move_count);
-
-    // track if all goals are reached
-    int goal = 0;
-    for (int i = 0; i < PROFILE_COUNT; i++) {
-        const auto& profile = PROFILES[i];
-        switch (profile.name) {
-            case target_combo: {
-                int target = profile.target;
-                int preferred_combo = 0;
-                for (const auto& c : all_list) {
-                    if (profile.orbs[c.info])
-                        preferred_combo++;
-                }
-                int guide = adjacency_score(&profile);
-                if (target == -1) {
-                    // max combo
-                    score += combo * 1000 + guide - new_state.step;
-                    if (profile.colour_target <= 0) {
-                        score += preferred_combo * 300;
-                    } else {
-                        int lack = profile.colour_target - preferred_combo;
-                        if (lack > 0)
-                            score -= lack * 1500;
-                        else
-                            score += preferred_combo * 300;
-                    }
-                    if (combo == MAX_COMBO &&
-                        (profile.colour_target <= 0 || preferred_combo >= profile.colour_target))
-                        goal++;
-                } else {
-                    // only do max target combo
-                    if (combo < target)
-                        score -= (target - combo) * 1000;
-                    if (combo == target)
-                        score += combo * 1000 + guide - new_state.step;
-                    else if (target > 7)
-                        score -= 500;
-
-                    if (profile.colour_target <= 0) {
-                        score += preferred_combo * 300;
-                    } else {
-                        int lack = profile.colour_target - preferred_combo;
-                        if (lack > 0)
-                            score -= lack * 1500;
-                        else
-                            score += preferred_combo * 300;
-                    }
-
-                    if (combo == target &&
-                        (profile.colour_target <= 0 || preferred_combo >= profile.colour_target))
-                        goal++;
-                }
-            } break;
-
-            case colour: {
-                int colour_counter[ORB_COUNT]{0};
-                for (const auto& c : all_list) {
-                    colour_counter[c.info]++;
-                }
-
-                bool has_all_target_colours = true;
-                for (int j = 0; j < ORB_COUNT; j++) {
-                    // this orb should be included
-                    if (profile.orbs[j]) {
-                        // just add a tiny score, don't do too much
-                        if (colour_counter[j] == 0)
-                            has_all_target_colours = false;
-                        else
-                            score += 2;
-                    }
-                }
-
-                if (has_all_target_colours)
-                    goal++;
-            } break;
-
-            case colour_combo: {
-                int colour_counter[ORB_COUNT]{0};
-                for (const auto& c : all_list) {
-                    colour_counter[c.info]++;
-                }
-
-                bool fulfilled = true;
-                for (int j = 0; j < ORB_COUNT; j++) {
-                    // this orb should be included
-                    if (profile.orbs[j]) {
-                        int colour_combo = colour_counter[j];
-                        // just add a tiny score, don't do too much
-                        if (colour_combo == 0)
-                            fulfilled = false;
-                        else if (colour_combo >= profile.target)
-                            score += 2;
-                    }
-                }
-
-                if (fulfilled)
-                    goal++;
-            } break;
-
-            case connected_orb: {
-                int target = profile.target;
-                bool fulfilled = false;
-                bool has_orb_filter = false;
-                for (int j = 0; j < ORB_COUNT; ++j) {
-                    if (profile.orbs[j]) {
-                        has_orb_filter = true;
-                        break;
-                    }
-                }
-
-                for (const auto& c : all_list) {
-                    if (has_orb_filter && !profile.orbs[c.info])
-                        continue;
-                    int connected_count = c.loc.size();
-                    if (ORB_COUNTER[c.info] >= target) {
-                        if (connected_count < target) {
-                            score += (connected_count - MIN_ERASE) * 10;
-                        } else if (connected_count == target) {
-                            fulfilled = true;
-                            score += 100;
-                        } else {
-                            score -= (connected_count - target) * 50;
-                        }
-                    }
-                }
-
-                score += combo * 20;
-                if (fulfilled)
-                    score += 20000;
-
-                if (fulfilled)
-                    goal++;
-            } break;
-
-            case orb_remaining: {
-                int remaining = 0;
-                for (int j = 0; j < BOARD_SIZE; j++) {
-                    if (copy[j] > 0)
-                        remaining++;
-                }
-
-                if (remaining <= profile.target)
-                    goal++;
-                score -= remaining * 10;
-            } break;
-
-            case shape_L: {
-                for (const auto& c : all_list) {
-                    if (profile.orbs[c.info] && ORB_COUNTER[c.info] >= 5) {
-                        int size = c.loc.size();
-                        if (size == 5) {
-                            // some score for connecting more orbs
-                            // check if it is L shape
-                            std::map<int, int> vertical;
-                            std::map<int, int> horizontal;
-                            int bigFirst = -1;
-                            int bigSecond = -1;
-
-                            // Collect info
-                            for (const auto& loc : c.loc) {
-                                int x = loc % COLUMN;
-                                int y = loc / COLUMN;
-                                vertical[x]++;
-                                horizontal[y]++;
-
-                                // Track the largest number
-                                if (vertical[x] >= 3)
-                                    bigFirst = x;
-                                if (horizontal[y] >= 3)
-                                    bigSecond = y;
-                            }
-
-                            // This is the center point
-                            if (bigFirst > -1 && bigSecond > -1) {
-                                int counter = 0;
-                                // Check if bigFirst -2 or +2 exists
-                                if (vertical[bigFirst - 2] > 0 ||
-                                    vertical[bigFirst + 2] > 0)
-                                    counter++;
-                                // Same for bigSecond
-                                if (horizontal[bigSecond - 2] > 0 ||
-                                    horizontal[bigSecond + 2] > 0)
-                                    counter++;
-
-                                if (counter == 2)
-                                    score += 50;
-                            }
-                        } else if (size > 3) {
-                            score += 10;
-                        }
-                    }
-                }
-
-                // consider combo here as well
-                score += combo * 20;
-            } break;
-
-            case shape_plus: {
-                for (const auto& c : all_list) {
-                    if (profile.orbs[c.info] && ORB_COUNTER[c.info] >= 5) {
-                        int size = c.loc.size();
-                        if (size <= 5)
-                            score += (size - MIN_ERASE) * 10;
-
-                        // some score for connecting more orbs
-                        // check if it is L shape
-                        std::map<int, int> vertical;
-                        std::map<int, int> horizontal;
-                        int bigFirst = -1;
-                        int bigSecond = -1;
-
-                        // Collect info
-                        for (const auto& loc : c.loc) {
-                            int x = loc % COLUMN;
-                            int y = loc / COLUMN;
-                            vertical[x]++;
-                            horizontal[y]++;
-
-                            // Track the largest number
-                            if (vertical[x] >= 3)
-                                bigFirst = x;
-                            if (horizontal[y] >= 3)
-                                bigSecond = y;
-                        }
-
-                        // This is the center point
-                        if (bigFirst > -1 && bigSecond > -1) {
-                            int counter = 0;
-                            // Check up down left right there is an orb around
-                            // center orb
-                            if (vertical[bigFirst - 1] > 0 &&
-                                vertical[bigFirst + 1] > 0)
-                                counter++;
-                            if (horizontal[bigSecond - 1] > 0 &&
-                                horizontal[bigSecond + 1] > 0)
-                                counter++;
-
-                            if (counter == 2)
-                                score += 50;
-                            if (counter == 1)
-                                score += 10;
-                        }
-                    }
-                }
-            } break;
-
-            case shape_square: {
-                // FORCE 3x3 MODE: Massively prioritize 3x3 squares over everything else
-                bool found_3x3 = false;
-                for (const auto& c : all_list) {
-                    if (profile.orbs[c.info] && ORB_COUNTER[c.info] >= 9) {
-                        int size = c.loc.size();
-                        if (size >= 9) {
-                            // Check if it forms a 3x3 square
-                            if (is_3x3_square(c.loc, COLUMN)) {
-                                score += 50000;  // MASSIVE score for 3x3
-                                goal++;
-                                found_3x3 = true;
-                            }
-                        }
-                    }
-                }
-                
-                // If we found a 3x3, ignore all other scoring
-                if (found_3x3) {
-                    new_state.combo = combo;
-                    new_state.score = score;
-                    new_state.goal = (goal > 0);
-                    return;
-                }
-                
-                // If no 3x3 found, look for potential 3x3 formation
-                // Check for clusters of 6+ orbs that could become 3x3
-                for (const auto& c : all_list) {
-                    if (ORB_COUNTER[c.info] >= 9) {
-                        int size = c.loc.size();
-                        if (size >= 6) {
-                            score += size * 20;  // Reward large clusters
-                        }
-                    }
-                }
-                
-                // Check 3x3 potential for each color with 9+ orbs
-                for (int orb_type = 1; orb_type < ORB_COUNT; orb_type++) {
-                    if (ORB_COUNTER[orb_type] >= 9) {
-                        // Analyze 3x3 potential for this orb type
-                        for (int top_row = 0; top_row <= ROW - 3; top_row++) {
-                            for (int top_col = 0; top_col <= COLUMN - 3; top_col++) {
-                                int matching_orbs = 0;
-                                
-                                // Count matching orbs in this 3x3 area
-                                for (int i = 0; i < 3; i++) {
-                                    for (int j = 0; j < 3; j++) {
-                                        int pos = (top_row + i) * COLUMN + (top_col + j);
-                                        if (copy[pos] == orb_type) {
-                                            matching_orbs++;
-                                        }
-                                    }
-                                }
-                                
-                                // Score based on 3x3 potential
-                                if (matching_orbs >= 6) {
-                                    score += 1000;  // Very close to 3x3
-                                } else if (matching_orbs >= 4) {
-                                    score += 200;   // Good potential
-                                } else if (matching_orbs >= 2) {
-                                    score += 50;    // Some potential
-                                }
-                            }
-                        }
-                    }
-                }
-            } break;
-
-            case shape_row: {
-            } break;
-
-            case shape_column: {
-            } break;
-
-            default: {
-                printf("unknown profile %d\n", profile.name);
-                exit(1);
-            } break;
-        }
-    }
-
-    new_state.combo = combo;
-    new_state.score = score;
-
-    if (goal == PROFILE_COUNT) {
-        new_state.goal = true;
-    }
+    evaluation_plan plan;
+    plan.profiles = PROFILES;
+    plan.count = PROFILE_COUNT;
+    plan.verdicts = VERDICTS.data();
+    plan.goal_count = GOAL_COUNT;
+    plan.step = new_state.step;
+    plan.max_combo = MAX_COMBO;
+    auto result = evaluate_board(board, ROW, COLUMN, MIN_ERASE, &plan);
+    new_state.combo = result.combo;
+    new_state.score = result.score;
+    new_state.goal = result.goal;
 }
 
 void solver::erase_combo(game_board& board, combo_list& list) {
@@ -779,30 +472,267 @@ void solver::move_orbs_down(game_board& board) {
     }
 }
 
-int solver::calc_max_combo(const orb_list& counter,
-                           const int size,
-                           const int min_erase) const {
-    // at least one combo when the board has only one orb
-    int max_combo = 0;
-    int threshold = size / 2;
-    for (const auto& count : counter) {
-        int combo = count / min_erase;
-        // based on my experience, it is not possible to do more combo
-        // if one colour has more than half the board
-        // the max combo needs to be reduced by 2 times
-        // RRRRRRRRRRRRRRRRRRRRRRRRGGGBBB can do max 4 combos naively
-        // this is because R is taking up too much spaces
-        // MAX_COMBO might not be 100% correct but it's a good reference
-        if (count > threshold) {
-            int extra_combo = (count - threshold) * 2 / min_erase;
-            combo -= extra_combo;
+int solver::calc_max_combo(const orb_list& counter, const int min_erase) const {
+    return estimate_max_combo(counter, ROW, COLUMN, min_erase);
+}
+
+int solver::combo_upper_bound(const game_board& board,
+                              const int finger,
+                              const int remaining,
+                              int* colour_combo) const {
+    // only cells the finger can still reach are able to change, the rest stay
+    // in their column forever because orbs can only fall after erasing
+    std::array<bool, MAX_BOARD_LENGTH> movable{};
+    int finger_row = finger / COLUMN;
+    int finger_col = finger % COLUMN;
+    orb_list counter{};
+    orb_list movable_counter{};
+    int open[MAX_BOARD_LENGTH]{0};
+    int fixed[ORB_COUNT][MAX_BOARD_LENGTH]{};
+    for (int i = 0; i < BOARD_SIZE; i++) {
+        int dr = std::abs(i / COLUMN - finger_row);
+        int dc = std::abs(i % COLUMN - finger_col);
+        int distance = ALLOW_DIAGONAL ? std::max(dr, dc) : dr + dc;
+        movable[i] = !BLOCKED[i] && distance <= remaining;
+
+        auto o = board[i];
+        counter[o]++;
+        if (movable[i]) {
+            movable_counter[o]++;
+            open[i % COLUMN]++;
+        } else {
+            fixed[o][i % COLUMN]++;
+        }
+    }
+
+    int total = 0;
+    for (int o = 1; o < ORB_COUNT; o++) {
+        colour_combo[o] = 0;
+        if (counter[o] < MIN_ERASE)
+            continue;
+
+        // the most orbs of this colour each column can have after moving
+        int most[MAX_BOARD_LENGTH];
+        for (int col = 0; col < COLUMN; col++)
+            most[col] = fixed[o][col] + std::min<int>(open[col], movable_counter[o]);
+
+        // a fixed orb is stray if it can neither be part of a vertical combo in
+        // its column nor a horizontal one across MIN_ERASE columns
+        int stray = 0;
+        for (int col = 0; col < COLUMN; col++) {
+            if (fixed[o][col] == 0 || most[col] >= MIN_ERASE)
+                continue;
+            bool horizontal = false;
+            for (int left = col - MIN_ERASE + 1; left <= col; left++) {
+                if (left < 0 || left + MIN_ERASE > COLUMN)
+                    continue;
+                bool filled = true;
+                for (int c = left; c < left + MIN_ERASE; c++) {
+                    if (most[c] == 0) {
+                        filled = false;
+                        break;
+                    }
+                }
+                if (filled) {
+                    horizontal = true;
+                    break;
+                }
+            }
+            if (!horizontal)
+                stray += fixed[o][col];
+        }
+
+        colour_combo[o] = (counter[o] - stray) / MIN_ERASE;
+        total += colour_combo[o];
+    }
+    return total;
+}
+
+bool solver::can_prune(const state& current, const int best_score) const {
+    if (PROFILE_COUNT == 0 || best_score <= MIN_STATE_SCORE + 1)
+        return false;
+
+    // the first step starts from the original board
+    const auto& board = current.step == 0 ? BOARD : current.board;
+    int colour_combo[ORB_COUNT]{0};
+    int combo = combo_upper_bound(board, current.curr,
+                                  SEARCH_DEPTH - current.step, colour_combo);
+
+    // every child takes at least one more step, adjacency guide is capped at
+    // 200 and the orb distance penalty is never positive
+    int step = current.step + 1;
+    int bound = 0;
+    bool goal_reachable = true;
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        const auto& profile = PROFILES[i];
+        if (profile.name != target_combo)
+            return false;
+
+        int preferred = 0;
+        for (int o = 1; o < ORB_COUNT; o++) {
+            if (profile.orbs[o])
+                preferred += colour_combo[o];
+        }
+        preferred = std::min(preferred, combo);
+        bound += preferred * 300;
+
+        int target = VERDICTS[i].target;
+        if (target == -1) {
+            bound += combo * 1000 + 200 - step;
+            // see evaluate_board(), an inexact max combo is never a goal
+            if (combo < MAX_COMBO || MAX_COMBO != count_max_combo(ORB_COUNTER, MIN_ERASE))
+                goal_reachable = false;
+        } else {
+            if (combo >= target)
+                bound += std::max(0, target * 1000 + 200 - step);
+            else
+                goal_reachable = false;
         }
-        max_combo += combo;
     }
 
-    if (max_combo == 0)
-        return 1;
-    return max_combo;
+    return !goal_reachable && bound <= best_score;
+}
+
+void solver::check_profiles() {
+    VERDICTS.assign(PROFILE_COUNT, profile_verdict());
+    GOAL_COUNT = 0;
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        VERDICTS[i].target = PROFILES[i].target;
+        VERDICTS[i].colour_target = PROFILES[i].colour_target;
+    }
+    // nothing to check against yet
+    if (BOARD_SIZE == 0) {
+        GOAL_COUNT = PROFILE_COUNT;
+        return;
+    }
+
+    // orbs can be moved freely so only the count of each colour matters
+    int colour_max[ORB_COUNT]{0};
+    int combo_bound = 0;
+    for (int o = 1; o < ORB_COUNT; o++) {
+        colour_max[o] = ORB_COUNTER[o] / MIN_ERASE;
+        combo_bound += colour_max[o];
+    }
+
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        const auto& profile = PROFILES[i];
+        auto& verdict = VERDICTS[i];
+        bool has_orb_filter = false;
+        for (int o = 1; o < ORB_COUNT; o++) {
+            if (profile.orbs[o])
+                has_orb_filter = true;
+        }
+
+        switch (profile.name) {
+            case target_combo: {
+                // max combo is only a reachable packing, the counting bound
+                // is what really can't be exceeded
+                if (profile.target > combo_bound) {
+                    verdict.feasible = false;
+                    verdict.target = MAX_COMBO;
+                }
+                if (profile.colour_target > 0) {
+                    int preferred = 0;
+                    for (int o = 1; o < ORB_COUNT; o++) {
+                        if (profile.orbs[o])
+                            preferred += colour_max[o];
+                    }
+                    preferred = std::min(preferred, combo_bound);
+                    if (profile.colour_target > preferred) {
+                        verdict.feasible = false;
+                        verdict.colour_target = preferred;
+                    }
+                }
+                verdict.relaxed = !verdict.feasible;
+            } break;
+
+            case colour:
+            case colour_combo: {
+                // every colour needs a combo, only erasable ones are kept
+                int wanted = 0;
+                int erasable = 0;
+                int most = MAX_BOARD_LENGTH;
+                for (int o = 1; o < ORB_COUNT; o++) {
+                    if (!profile.orbs[o])
+                        continue;
+                    wanted++;
+                    if (colour_max[o] > 0) {
+                        erasable++;
+                        most = std::min(most, colour_max[o]);
+                    }
+                }
+                if (erasable < wanted)
+                    verdict.feasible = false;
+                if (profile.name == colour_combo && erasable > 0 &&
+                    profile.target > most) {
+                    verdict.feasible = false;
+                    verdict.target = most;
+                }
+                verdict.relaxed = !verdict.feasible && erasable > 0;
+            } break;
+
+            case connected_orb: {
+                int most = 0;
+                for (int o = 1; o < ORB_COUNT; o++) {
+                    if (!has_orb_filter || profile.orbs[o])
+                        most = std::max<int>(most, ORB_COUNTER[o]);
+                }
+                if (profile.target < MIN_ERASE || profile.target > most) {
+                    verdict.feasible = false;
+                    if (most >= MIN_ERASE) {
+                        verdict.relaxed = true;
+                        verdict.target =
+                            profile.target < MIN_ERASE ? MIN_ERASE : most;
+                    }
+                }
+            } break;
+
+            case orb_remaining: {
+                // colours with less than min erase orbs always stay
+                int stuck = 0;
+                for (int o = 1; o < ORB_COUNT; o++) {
+                    if (colour_max[o] == 0)
+                        stuck += ORB_COUNTER[o];
+                }
+                if (profile.target < stuck) {
+                    verdict.feasible = false;
+                    verdict.relaxed = true;
+                    verdict.target = stuck;
+                }
+            } break;
+
+            case shape_L:
+            case shape_plus:
+            case shape_square:
+            case shape_row:
+            case shape_column: {
+                int needed = 5;
+                if (profile.name == shape_square)
+                    needed = ROW >= 3 && COLUMN >= 3 ? 9 : MAX_BOARD_LENGTH + 1;
+                else if (profile.name == shape_row)
+                    needed = COLUMN;
+                else if (profile.name == shape_column)
+                    needed = ROW;
+
+                bool possible = false;
+                for (int o = 1; o < ORB_COUNT; o++) {
+                    if (profile.orbs[o] && ORB_COUNTER[o] >= needed)
+                        possible = true;
+                }
+                // a shape can't be relaxed into another one
+                verdict.feasible = possible;
+            } break;
+
+            default:
+                break;
+        }
+
+        if (verdict.feasible || verdict.relaxed)
+            GOAL_COUNT++;
+        DEBUG_PRINT("Profile %d - feasible %d, relaxed %d, target %d\n",
+                    profile.name, verdict.feasible, verdict.relaxed,
+                    verdict.target);
+    }
 }
 
 void solver::parse_args(int argc, char* argv[]) {
@@ -861,6 +791,18 @@ void solver::parse_args(int argc, char* argv[]) {
                 positions.push_back(INDEX_OF(row, col));
             }
             set_blocked(positions.data(), (int)positions.size());
+        } else if (strcmp(argv[i], "--no-prune") == 0) {
+            set_pruning(false);
+        } else if (strncmp(argv[i], "--refine=", 9) == 0) {
+            int depth = 0;
+            int candidates = REFINE_CANDIDATES;
+            int time = REFINE_TIME;
+            sscanf(argv[i] + 9, "%d,%d,%d", &depth, &candidates, &time);
+            set_refine(depth, candidates, time);
+        } else if (strcmp(argv[i], "--shorten") == 0) {
+            set_shorten(true);
+        } else if (strncmp(argv[i], "--commit=", 9) == 0) {
+            set_commit(atof(argv[i] + 9));
         }
     }
 
@@ -872,6 +814,10 @@ void solver::parse_args(int argc, char* argv[]) {
     DEBUG_PRINT("search_depth: %d\n", SEARCH_DEPTH);
     DEBUG_PRINT("beam_size: %d\n", BEAM_SIZE);
     DEBUG_PRINT("diagonal_movement: %s\n", ALLOW_DIAGONAL ? "enabled" : "disabled");
+    DEBUG_PRINT("pruning: %s\n", PRUNING ? "enabled" : "disabled");
+    DEBUG_PRINT("refine depth: %d\n", REFINE_DEPTH);
+    DEBUG_PRINT("shorten: %s\n", SHORTEN ? "enabled" : "disabled");
+    DEBUG_PRINT("commit ratio: %.2f\n", COMMIT_RATIO);
     DEBUG_PRINT("====================================\n");
 }
 
@@ -932,7 +878,8 @@ void solver::set_board(const char* board_string) {
         }
     }
 
-    MAX_COMBO = calc_max_combo(ORB_COUNTER, BOARD_SIZE, MIN_ERASE);
+    MAX_COMBO = calc_max_combo(ORB_COUNTER, MIN_ERASE);
+    check_profiles();
 }
 
 void solver::set_min_erase(int min_erase) {
@@ -945,6 +892,11 @@ void solver::set_min_erase(int min_erase) {
         DEBUG_PRINT("min_erase is too large, set to 5\n");
     }
     MIN_ERASE = min_erase;
+    // max combo depends on min erase as well
+    if (BOARD_SIZE > 0) {
+        MAX_COMBO = calc_max_combo(ORB_COUNTER, MIN_ERASE);
+        check_profiles();
+    }
 }
 
 void solver::set_search_depth(int depth) {
@@ -956,6 +908,8 @@ void solver::set_search_depth(int depth) {
 void solver::set_beam_size(int beam_size) {
     if (beam_size < MIN_BEAM_SIZE)
         beam_size = MIN_BEAM_SIZE;
+    else if (beam_size > MAX_BEAM_SIZE)
+        beam_size = MAX_BEAM_SIZE;
     BEAM_SIZE = beam_size;
 }
 
@@ -971,6 +925,7 @@ void solver::set_profiles(profile* profiles, int count) {
         if (STOP_THRESHOLD < profiles[i].stop_threshold)
             STOP_THRESHOLD = profiles[i].stop_threshold;
     }
+    check_profiles();
 }
 
 void solver::set_blocked(const int* positions, int count) {
@@ -989,6 +944,65 @@ void solver::set_blocked(const int* positions, int count) {
     }
 }
 
+void solver::set_pruning(bool pruning) {
+    PRUNING = pruning;
+}
+
+void solver::set_shorten(bool shorten) {
+    SHORTEN = shorten;
+}
+
+void solver::set_commit(double ratio) {
+    // less than half of the beam can't be a majority
+    if (ratio <= 0)
+        ratio = 0;
+    else if (ratio < 0.5)
+        ratio = 0.5;
+    else if (ratio > 1)
+        ratio = 1;
+    COMMIT_RATIO = ratio;
+}
+
+void solver::set_commit_callback(std::function<void(const state&)> callback) {
+    COMMIT_CALLBACK = callback;
+}
+
+void solver::set_progress(search_progress* progress) {
+    PROGRESS = progress;
+}
+
+void solver::set_workspace(workspace* space) {
+    WORKSPACE = space;
+}
+
+void solver::set_cache(solution_cache* cache) {
+    CACHE = cache;
+}
+
+void solver::set_threads(int count) {
+    THREAD_COUNT = std::max(count, 0);
+}
+
+int solver::thread_count() const {
+    if (THREAD_COUNT > 0)
+        return THREAD_COUNT;
+    return default_thread_count();
+}
+
+void solver::set_refine(int depth, int candidates, int time) {
+    if (depth < 0)
+        depth = 0;
+    else if (depth > MAX_DEPTH)
+        depth = MAX_DEPTH;
+    if (candidates < 1)
+        candidates = 1;
+    if (time < 0)
+        time = 0;
+    REFINE_DEPTH = depth;
+    REFINE_CANDIDATES = candidates;
+    REFINE_TIME = time;
+}
+
 void solver::print_board(const game_board& board) const {
     printf("Board: ");
     for (int i = 0; i < BOARD_SIZE; i++) {
@@ -1131,7 +1145,7 @@ bool solver::is_3x3_square(const std::unordered_set<int>& locations, int column)
     // Check if all 9 positions in the 3x3 square starting from (min_row, min_col) are present
     for (int i = 0; i < 3; i++) {
         for (int j = 0; j < 3; j++) {
-            int expected_loc = INDEX_OF(min_row + i, min_col + j);
+            int expected_loc = (min_row + i) * column + min_col + j;
             if (locations.find(expected_loc) == locations.end()) {
                 return false;
             }
@@ -1149,7 +1163,26 @@ void solver::usage() const {
         "steps\t-- maximum steps before the program stops "
         "searching\nmax beam size\t-- the width of the search space, "
         "larger number means slower speed but better results\ndiagonal\t-- "
-        "--diagonal or -d to enable diagonal movement (default: disabled)\n\nMore "
+        "--diagonal or -d to enable diagonal movement (default: disabled)\n"
+        "--no-prune\t-- expand states even if they can't beat the best "
+        "state\nrefine\t-- --refine=depth[,candidates[,ms]] to search the "
+        "last steps of the best states again (default: disabled)\n"
+        "shorten\t-- --shorten to remove wasted moves from the route "
+        "(default: disabled)\ncommit\t-- --commit=ratio to decide the route "
+        "prefix this share of the beam agrees on early (default: disabled)"
+        "\n\nusage: pazusoba --daemon[=socket] [--workers=N] [--threads=N] "
+        "[--metrics=port or socket] [--cache=file] [--cache-size=N]\n"
+        "answer requests from stdin or a unix socket line by line, see "
+        "include/pazusoba/service.h, SIGUSR1 prints the metrics, boards "
+        "seen before are answered from the cache file"
+        "\n\nusage: pazusoba --bulk[=file] [--jobs=N] [--threads=N] "
+        "[--cache=file] [--cache-size=N] [key=value]...\n"
+        "solve a file or stdin line by line and print the results in order, "
+        "key=value options apply to every line, the file can be a corpus"
+        "\n\nusage: pazusoba --pack=corpus [file]\n"
+        "pack lines of boards with blocked= and expected=combo into a binary "
+        "corpus"
+        "\n\nMore "
         "at https://github.com/pazusoba/core\n\n");
     exit(0);
 }
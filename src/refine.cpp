@@ -0,0 +1,132 @@
+// refine.cpp
+// Beam search drops states which look worse early on, the last few steps of
+// the best routes are searched again exhaustively to pick up missed combos.
+
+#include <pazusoba/core.h>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace pazusoba {
+namespace {
+
+// adventure() returns a goal state as soon as it is found so goals come first
+bool is_better(const state& a, const state& b) {
+    if (a.goal != b.goal)
+        return a.goal;
+    return a.score > b.score;
+}
+
+struct tail_search {
+    solver& owner;
+    int max_children;
+    const std::chrono::steady_clock::time_point& deadline;
+    // hash -> the fewest steps it was reached with
+    std::unordered_map<long long int, int> seen;
+    state best;
+    bool timeout = false;
+
+    tail_search(solver& s,
+                int children,
+                const std::chrono::steady_clock::time_point& d)
+        : owner(s), max_children(children), deadline(d) {}
+
+    void search(const state& current, int remaining) {
+        std::vector<state> children(max_children);
+        owner.expand(current.board, current, children, 0);
+        for (const auto& child : children) {
+            if (child.score == MIN_STATE_SCORE)
+                continue;
+            if (std::chrono::steady_clock::now() > deadline) {
+                timeout = true;
+                return;
+            }
+
+            // the same board was reached before with enough steps left
+            auto it = seen.find(child.hash);
+            if (it != seen.end() && it->second <= child.step)
+                continue;
+            seen[child.hash] = child.step;
+
+            if (is_better(child, best))
+                best = child;
+            if (remaining > 1 && !child.goal)
+                search(child, remaining - 1);
+            if (timeout)
+                return;
+        }
+    }
+};
+
+}  // namespace
+
+state solver::refine(const std::vector<state>& candidates) {
+    if (candidates.empty())
+        return state();
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(REFINE_TIME);
+    int count = candidates.size();
+    std::vector<state> results(candidates);
+
+    int processor_count = thread_count();
+    processor_count = std::min(processor_count, count);
+    std::vector<std::thread> threads;
+    threads.reserve(processor_count);
+    for (int thread_num = 0; thread_num < processor_count; thread_num++) {
+        threads.emplace_back([&, thread_num] {
+            for (int i = thread_num; i < count; i += processor_count)
+                results[i] = refine_tail(candidates[i], deadline);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    // ties go to the better candidate from the beam
+    state best = results[0];
+    for (int i = 1; i < count; i++) {
+        if (is_better(results[i], best))
+            best = results[i];
+    }
+    return best;
+}
+
+state solver::refine_tail(const state& target,
+                          const std::chrono::steady_clock::time_point& deadline) {
+    // the committed prefix can't be changed any more
+    int depth = std::min<int>(REFINE_DEPTH, target.step - COMMITTED.step);
+    if (depth <= 0)
+        return target;
+
+    // undo the swaps of the tail to get the board it starts from
+    auto directions = decode_route(target.route, target.step);
+    state root;
+    root.board = target.board;
+    root.begin = target.begin;
+    root.step = target.step - depth;
+    int curr = target.curr;
+    for (int s = target.step - 1; s >= root.step; s--) {
+        int prev = curr - DIRECTION_ADJUSTMENTS[directions[s]];
+        std::swap(root.board[curr], root.board[prev]);
+        curr = prev;
+    }
+    root.curr = curr;
+    root.prev = curr;
+    if (root.step > 0)
+        root.prev = curr - DIRECTION_ADJUSTMENTS[directions[root.step - 1]];
+    for (int s = 0; s < root.step; s++) {
+        int index = s / ROUTE_PER_LIST;
+        root.route[index] = root.route[index] << 3 | directions[s];
+    }
+
+    tail_search tail(*this, ALLOW_DIAGONAL ? DIRECTION_COUNT : 4, deadline);
+    tail.best = target;
+    tail.search(root, depth);
+    DEBUG_PRINT("Refine - score %d to %d, %zu boards%s\n", target.score,
+                tail.best.score, tail.seen.size(),
+                tail.timeout ? ", timeout" : "");
+    return tail.best;
+}
+
+}  // namespace pazusoba
@@ -0,0 +1,490 @@
+// route.cpp
+// Routes from the beam search or the shape solver often have loops and
+// detours. Parts of the route are connected again with a bidirectional BFS
+// over (board, finger) so the final board stays exactly the same.
+
+#include <pazusoba/core.h>
+#include <algorithm>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+namespace pazusoba {
+namespace {
+
+struct grid {
+    int rows;
+    int cols;
+    int direction_count;
+    const std::array<bool, MAX_BOARD_LENGTH>& blocked;
+};
+
+// a random number for every orb in every cell and for every finger, the
+// hash of a board is all of them xored so a swap only changes six
+struct zobrist_table {
+    unsigned long long int orbs[MAX_BOARD_LENGTH][ORB_COUNT];
+    unsigned long long int fingers[MAX_BOARD_LENGTH];
+
+    zobrist_table() {
+        // splitmix64, the numbers are the same in every run
+        unsigned long long int seed = 0;
+        auto next = [&seed]() {
+            unsigned long long int z = (seed += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        };
+        for (int i = 0; i < MAX_BOARD_LENGTH; i++) {
+            for (int o = 0; o < ORB_COUNT; o++)
+                orbs[i][o] = next();
+            fingers[i] = next();
+        }
+    }
+};
+
+const zobrist_table& zobrist() {
+    static const zobrist_table table;
+    return table;
+}
+
+unsigned long long int board_hash(const grid& g, const game_board& board, int finger) {
+    const auto& z = zobrist();
+    unsigned long long int hash = z.fingers[finger];
+    for (int i = 0; i < g.rows * g.cols; i++)
+        hash ^= z.orbs[i][board[i]];
+    return hash;
+}
+
+// the hash after the finger swaps with next, the board is not swapped yet
+unsigned long long int swap_hash(unsigned long long int hash,
+                                 const game_board& board,
+                                 int finger,
+                                 int next) {
+    const auto& z = zobrist();
+    orb held = board[finger];
+    orb other = board[next];
+    return hash ^ z.orbs[finger][held] ^ z.orbs[next][other] ^ z.orbs[finger][other] ^
+           z.orbs[next][held] ^ z.fingers[finger] ^ z.fingers[next];
+}
+
+// the finger after the move or -1 if it can't go there
+int next_finger(const grid& g, int finger, int direction) {
+    static const int DR[DIRECTION_COUNT] = {-1, 1, 0, 0, -1, -1, 1, 1};
+    static const int DC[DIRECTION_COUNT] = {0, 0, -1, 1, -1, 1, -1, 1};
+    int row = finger / g.cols + DR[direction];
+    int col = finger % g.cols + DC[direction];
+    if (row < 0 || row >= g.rows || col < 0 || col >= g.cols)
+        return -1;
+    int next = row * g.cols + col;
+    if (g.blocked[next])
+        return -1;
+    return next;
+}
+
+int direction_of(char move) {
+    for (int i = 0; i < DIRECTION_COUNT; i++) {
+        if (DIRECTION_NAME[i] == move)
+            return i;
+    }
+    return -1;
+}
+
+// opposite directions are next to each other, up & down, up left & down right
+int reverse_of(int direction) {
+    static const int REVERSE[DIRECTION_COUNT] = {1, 0, 3, 2, 7, 6, 5, 4};
+    return REVERSE[direction];
+}
+
+struct search_node {
+    game_board board;
+    unsigned long long int hash;
+    int finger;
+    int parent;
+    // direction from the parent, reversed for the backward search
+    int direction;
+    int depth;
+};
+
+struct search_side {
+    std::vector<search_node> nodes;
+    // nodes are found by hash and the board is compared, a collision only
+    // means the same board may be searched twice
+    std::unordered_map<unsigned long long int, int> index;
+    int level_begin = 0;
+
+    void add(const game_board& board,
+             unsigned long long int hash,
+             int finger,
+             int parent,
+             int direction,
+             int depth) {
+        index[hash] = nodes.size();
+        nodes.push_back(search_node{board, hash, finger, parent, direction, depth});
+    }
+
+    int find(const game_board& board, unsigned long long int hash, int finger) const {
+        auto it = index.find(hash);
+        if (it == index.end())
+            return -1;
+        const auto& node = nodes[it->second];
+        return node.finger == finger && node.board == board ? it->second : -1;
+    }
+};
+
+// the route between two boards with no more than limit steps
+bool connect(const grid& g,
+             const game_board& from,
+             int from_finger,
+             const game_board& to,
+             int to_finger,
+             int limit,
+             std::string& route) {
+    route.clear();
+    if (from == to && from_finger == to_finger)
+        return true;
+
+    search_side sides[2];
+    sides[0].add(from, board_hash(g, from, from_finger), from_finger, -1, -1, 0);
+    sides[1].add(to, board_hash(g, to, to_finger), to_finger, -1, -1, 0);
+    int depth[2] = {0, 0};
+    int meet[2] = {-1, -1};
+
+    while (depth[0] + depth[1] < limit && meet[0] < 0) {
+        // expand the smaller side one level, swaps can be undone so going
+        // backward is the same as going forward
+        int size[2];
+        for (int k = 0; k < 2; k++)
+            size[k] = sides[k].nodes.size() - sides[k].level_begin;
+        int k = size[0] <= size[1] ? 0 : 1;
+        if (size[k] == 0)
+            return false;
+
+        auto& side = sides[k];
+        auto& other = sides[1 - k];
+        int level_end = side.nodes.size();
+        for (int n = side.level_begin; n < level_end && meet[0] < 0; n++) {
+            for (int d = 0; d < g.direction_count; d++) {
+                int finger = side.nodes[n].finger;
+                int next = next_finger(g, finger, d);
+                if (next < 0)
+                    continue;
+                game_board board = side.nodes[n].board;
+                auto hash = swap_hash(side.nodes[n].hash, board, finger, next);
+                std::swap(board[finger], board[next]);
+                if (side.find(board, hash, next) >= 0)
+                    continue;
+                side.add(board, hash, next, n, d, depth[k] + 1);
+
+                int found = other.find(board, hash, next);
+                if (found >= 0) {
+                    meet[k] = side.nodes.size() - 1;
+                    meet[1 - k] = found;
+                    break;
+                }
+            }
+        }
+        side.level_begin = level_end;
+        depth[k]++;
+    }
+
+    if (meet[0] < 0)
+        return false;
+
+    std::string forward;
+    for (int n = meet[0]; sides[0].nodes[n].parent >= 0; n = sides[0].nodes[n].parent)
+        forward += DIRECTION_NAME[sides[0].nodes[n].direction];
+    std::reverse(forward.begin(), forward.end());
+    route = forward;
+    for (int n = meet[1]; sides[1].nodes[n].parent >= 0; n = sides[1].nodes[n].parent)
+        route += DIRECTION_NAME[reverse_of(sides[1].nodes[n].direction)];
+    return true;
+}
+
+// boards and fingers after every step, false if the route is invalid
+bool replay(const grid& g,
+            const game_board& board,
+            int start,
+            const std::string& route,
+            std::vector<game_board>& boards,
+            std::vector<int>& fingers) {
+    boards.assign(1, board);
+    fingers.assign(1, start);
+    for (char move : route) {
+        int direction = direction_of(move);
+        if (direction < 0 || direction >= g.direction_count)
+            return false;
+        int finger = fingers.back();
+        int next = next_finger(g, finger, direction);
+        if (next < 0)
+            return false;
+        game_board current = boards.back();
+        std::swap(current[finger], current[next]);
+        boards.push_back(current);
+        fingers.push_back(next);
+    }
+    return true;
+}
+
+// no route between the two boards can be shorter than this
+int min_steps(const grid& g,
+              const game_board& from,
+              int from_finger,
+              const game_board& to,
+              int to_finger) {
+    int dr = std::abs(from_finger / g.cols - to_finger / g.cols);
+    int dc = std::abs(from_finger % g.cols - to_finger % g.cols);
+    int distance = g.direction_count == DIRECTION_COUNT ? std::max(dr, dc) : dr + dc;
+    // every step changes the finger cell and the one it moves to
+    int changed = 0;
+    for (int i = 0; i < g.rows * g.cols; i++) {
+        if (from[i] != to[i])
+            changed++;
+    }
+    return std::max(distance, changed - 1);
+}
+
+// combos and erased orbs of every colour including cascades
+bool same_outcome(const board_evaluation& a, const board_evaluation& b) {
+    return std::equal(a.colour_combo, a.colour_combo + ORB_COUNT, b.colour_combo) &&
+           std::equal(a.erased, a.erased + ORB_COUNT, b.erased);
+}
+
+// the shallowest board from the start of the tail with the same combos
+bool connect_outcome(const grid& g,
+                     int min_erase,
+                     const game_board& from,
+                     int from_finger,
+                     const board_evaluation& outcome,
+                     int limit,
+                     std::string& route) {
+    search_side side;
+    side.add(from, board_hash(g, from, from_finger), from_finger, -1, -1, 0);
+    for (size_t n = 0; n < side.nodes.size(); n++) {
+        if (side.nodes[n].depth > 0 &&
+            same_outcome(evaluate_board(side.nodes[n].board, g.rows, g.cols, min_erase),
+                         outcome)) {
+            route.clear();
+            for (int m = n; side.nodes[m].parent >= 0; m = side.nodes[m].parent)
+                route += DIRECTION_NAME[side.nodes[m].direction];
+            std::reverse(route.begin(), route.end());
+            return true;
+        }
+        if (side.nodes[n].depth >= limit)
+            continue;
+        for (int d = 0; d < g.direction_count; d++) {
+            int finger = side.nodes[n].finger;
+            int next = next_finger(g, finger, d);
+            if (next < 0)
+                continue;
+            game_board board = side.nodes[n].board;
+            auto hash = swap_hash(side.nodes[n].hash, board, finger, next);
+            std::swap(board[finger], board[next]);
+            if (side.find(board, hash, next) < 0)
+                side.add(board, hash, next, n, d, side.nodes[n].depth + 1);
+        }
+    }
+    return false;
+}
+
+// connect every part of the route again, the longest parts first
+bool shorten_windows(const grid& g,
+                     const game_board& board,
+                     int start,
+                     int window,
+                     std::string& route) {
+    std::vector<game_board> boards;
+    std::vector<int> fingers;
+    replay(g, board, start, route, boards, fingers);
+
+    bool shortened = false;
+    int i = 0;
+    while (i < (int)route.size()) {
+        bool improved = false;
+        int last = std::min<int>(route.size(), i + window);
+        for (int j = last; j >= i + 2 && !improved; j--) {
+            int limit = j - i - 1;
+            if (min_steps(g, boards[i], fingers[i], boards[j], fingers[j]) > limit)
+                continue;
+            std::string part;
+            if (connect(g, boards[i], fingers[i], boards[j], fingers[j], limit, part)) {
+                route = route.substr(0, i) + part + route.substr(j);
+                replay(g, board, start, route, boards, fingers);
+                improved = true;
+                shortened = true;
+            }
+        }
+        // try the same step again as the route after it has changed
+        if (!improved)
+            i++;
+    }
+    return shortened;
+}
+
+std::string board_string(const game_board& board, int size) {
+    std::string text(size, ORB_WEB_NAME[0]);
+    for (int i = 0; i < size; i++)
+        text[i] = ORB_WEB_NAME[board[i]];
+    return text;
+}
+
+}  // namespace
+
+int route_direction(const route_list& route, const int step, const int index) {
+    int list = index / ROUTE_PER_LIST;
+    // the last step is in the lowest bits and the last list may not be full
+    int count = std::min(step - list * ROUTE_PER_LIST, ROUTE_PER_LIST);
+    int shift = (count - 1 - index % ROUTE_PER_LIST) * 3;
+    return (route[list] >> shift) & 7;
+}
+
+std::vector<int> decode_route(const route_list& route, const int step) {
+    std::vector<int> directions(step);
+    for (int s = 0; s < step; s++)
+        directions[s] = route_direction(route, step, s);
+    return directions;
+}
+
+shortened_route shorten_route(const std::string& board,
+                              int rows,
+                              int cols,
+                              int start,
+                              const std::string& route,
+                              const route_options& options) {
+    std::array<bool, MAX_BOARD_LENGTH> blocked{};
+    blocked.fill(false);
+    return shorten_route(board, rows, cols, start, route, options, blocked);
+}
+
+shortened_route shorten_route(const std::string& board,
+                              int rows,
+                              int cols,
+                              int start,
+                              const std::string& route,
+                              const route_options& options,
+                              const std::array<bool, MAX_BOARD_LENGTH>& blocked) {
+    grid g{rows, cols, options.allow_diagonal ? DIRECTION_COUNT : 4, blocked};
+    shortened_route result;
+    result.start = start;
+    result.route = route;
+    result.steps = route.size();
+    result.final_board = board;
+
+    if (rows <= 0 || cols <= 0 || (int)board.size() != rows * cols ||
+        board.size() > MAX_BOARD_LENGTH || start < 0 || start >= rows * cols)
+        return result;
+    // boards are searched as orbs, unknown letters leave the route alone
+    game_board orbs{0};
+    for (size_t i = 0; i < board.size(); i++) {
+        const char* name = std::find(ORB_WEB_NAME, ORB_WEB_NAME + ORB_COUNT, board[i]);
+        if (name == ORB_WEB_NAME + ORB_COUNT)
+            return result;
+        orbs[i] = name - ORB_WEB_NAME;
+    }
+
+    std::vector<game_board> boards;
+    std::vector<int> fingers;
+    if (!replay(g, orbs, start, route, boards, fingers))
+        return result;
+    result.final_board = board_string(boards.back(), board.size());
+
+    std::string shortened = route;
+    shorten_windows(g, orbs, start, options.window, shortened);
+
+    if (options.same_combo && !shortened.empty()) {
+        auto outcome = evaluate_board(boards.back(), rows, cols, options.min_erase);
+
+        // only the end of the route is searched, the outcome is slow to check
+        replay(g, orbs, start, shortened, boards, fingers);
+        int length = shortened.size();
+        int tail = std::max(1, options.window / 2);
+        std::string best;
+        int best_length = length;
+        for (int i = std::max(0, length - options.window); i < length; i++) {
+            int limit = std::min(tail, best_length - i - 1);
+            std::string part;
+            if (limit > 0 && connect_outcome(g, options.min_erase, boards[i], fingers[i],
+                                             outcome, limit, part)) {
+                best = shortened.substr(0, i) + part;
+                best_length = best.size();
+            }
+        }
+        if (best_length < length) {
+            shortened = best;
+            shorten_windows(g, orbs, start, options.window, shortened);
+        }
+    }
+
+    replay(g, orbs, start, shortened, boards, fingers);
+    result.route = shortened;
+    result.steps = shortened.size();
+    result.saved = route.size() - shortened.size();
+    result.final_board = board_string(boards.back(), board.size());
+    return result;
+}
+
+std::string solver::get_route_string(const state& state) const {
+    std::string route;
+    for (int direction : decode_route(state.route, state.step))
+        route += DIRECTION_NAME[direction];
+    return route;
+}
+
+void solver::move(state& current, const int direction) const {
+    int next = current.curr + DIRECTION_ADJUSTMENTS[direction];
+    std::swap(current.board[current.curr], current.board[next]);
+    current.prev = current.curr;
+    current.curr = next;
+
+    current.step++;
+    int route_index = current.step / ROUTE_PER_LIST;
+    if (current.step % ROUTE_PER_LIST == 0)
+        route_index--;
+    current.route[route_index] = current.route[route_index] << 3 | direction;
+}
+
+state solver::shorten(const state& current) {
+    // the committed prefix may have been executed already
+    state result;
+    result.begin = current.begin;
+    result.curr = current.begin;
+    result.prev = current.begin;
+    result.board = BOARD;
+    if (COMMITTED_START)
+        result = COMMITTED;
+    if (current.step - result.step <= 1)
+        return current;
+
+    // empty orbs stop get_board_string() early
+    std::string board(BOARD_SIZE, ORB_WEB_NAME[0]);
+    for (int i = 0; i < BOARD_SIZE; i++)
+        board[i] = ORB_WEB_NAME[result.board[i]];
+
+    route_options options;
+    options.allow_diagonal = ALLOW_DIAGONAL;
+    options.same_combo = true;
+    options.min_erase = MIN_ERASE;
+    auto shortened = shorten_route(board, ROW, COLUMN, result.curr,
+                                   get_route_string(current).substr(result.step),
+                                   options, BLOCKED);
+    if (shortened.saved <= 0)
+        return current;
+
+    for (char letter : shortened.route) {
+        int direction = 0;
+        while (DIRECTION_NAME[direction] != letter)
+            direction++;
+        move(result, direction);
+    }
+    result.hash = hash::pazusoba_hash(result.board.data(), result.curr);
+    auto copy = result.board;
+    evaluate(copy, result);
+
+    // the same combos may still score less for other profiles
+    if (result.combo < current.combo || (current.goal && !result.goal) ||
+        result.score < current.score)
+        return current;
+    SAVED_STEPS = current.step - result.step;
+    return result;
+}
+
+}  // namespace pazusoba
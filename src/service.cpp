@@ -0,0 +1,277 @@
+// service.cpp
+// The line protocol used by the daemon and the bulk mode, requests are
+// checked here so a bad line can't make set_board() exit the process.
+
+#include <pazusoba/core.h>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace pazusoba {
+namespace {
+
+struct profile_alias {
+    const char* name;
+    int profile;
+};
+
+const profile_alias PROFILE_ALIASES[] = {
+    {"combo", target_combo},     {"colour", colour},
+    {"colour_combo", colour_combo}, {"connected", connected_orb},
+    {"remaining", orb_remaining}, {"L", shape_L},
+    {"plus", shape_plus},         {"square", shape_square},
+    {"row", shape_row},           {"column", shape_column},
+};
+
+bool parse_int(const std::string& text, int& value) {
+    if (text.empty())
+        return false;
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX)
+        return false;
+    value = (int)parsed;
+    return true;
+}
+
+bool parse_int_in(const std::string& text, int low, int high, int& value) {
+    return parse_int(text, value) && value >= low && value <= high;
+}
+
+int orb_of(char name) {
+    for (int o = 1; o < ORB_COUNT; o++) {
+        if (ORB_WEB_NAME[o] == name)
+            return o;
+    }
+    return -1;
+}
+
+bool parse_profile(const std::string& text, profile& p, std::string& error) {
+    std::vector<std::string> parts;
+    std::stringstream ss(text);
+    std::string part;
+    while (std::getline(ss, part, ':'))
+        parts.push_back(part);
+    if (parts.empty()) {
+        error = "empty profile";
+        return false;
+    }
+
+    p = profile();
+    for (const auto& alias : PROFILE_ALIASES) {
+        if (parts[0] == alias.name)
+            p.name = alias.profile;
+    }
+    if (p.name < 0) {
+        error = "unknown profile " + parts[0];
+        return false;
+    }
+    // same as the command line, combo keeps searching longer
+    if (p.name == target_combo)
+        p.stop_threshold = 100;
+    if (parts.size() > 1 && !parts[1].empty() && !parse_int(parts[1], p.target)) {
+        error = "invalid profile target " + parts[1];
+        return false;
+    }
+    if (parts.size() > 2) {
+        for (char c : parts[2]) {
+            int o = orb_of(c);
+            if (o < 0) {
+                error = std::string("invalid profile orb ") + c;
+                return false;
+            }
+            p.orbs[o] = true;
+        }
+    }
+    return true;
+}
+
+bool parse_tokens(const std::string& line,
+                  bool allow_board,
+                  solve_request& request,
+                  bool& has_board,
+                  std::string& error) {
+    std::stringstream ss(line);
+    std::string token;
+    bool has_profile = false;
+    while (ss >> token) {
+        size_t sep = token.find('=');
+        if (sep == std::string::npos) {
+            if (has_board || !allow_board) {
+                error = "unexpected " + token;
+                return false;
+            }
+            request.board = token;
+            has_board = true;
+            continue;
+        }
+
+        std::string key = token.substr(0, sep);
+        std::string value = token.substr(sep + 1);
+        bool valid = true;
+        if (key == "id") {
+            request.id = value;
+        } else if (key == "erase") {
+            valid = parse_int_in(value, 3, 5, request.min_erase);
+        } else if (key == "depth") {
+            valid = parse_int_in(value, 1, MAX_DEPTH, request.search_depth);
+        } else if (key == "beam") {
+            valid = parse_int_in(value, 1, MAX_BEAM_SIZE, request.beam_size);
+        } else if (key == "diagonal") {
+            valid = value == "0" || value == "1";
+            request.diagonal = value == "1";
+        } else if (key == "deadline") {
+            valid = parse_int(value, request.deadline) && request.deadline >= 0;
+        } else if (key == "blocked") {
+            request.blocked.clear();
+            std::stringstream cells(value);
+            std::string cell;
+            while (valid && std::getline(cells, cell, ',')) {
+                int index = 0;
+                valid = parse_int(cell, index);
+                request.blocked.push_back(index);
+            }
+        } else if (key == "profile") {
+            // the first profile on the line replaces the default ones
+            if (!has_profile)
+                request.profiles.clear();
+            has_profile = true;
+            profile p;
+            if (!parse_profile(value, p, error))
+                return false;
+            request.profiles.push_back(p);
+        } else {
+            error = "unknown key " + key;
+            return false;
+        }
+        if (!valid) {
+            error = "invalid " + key + " " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool parse_options(const std::string& line, solve_request& request, std::string& error) {
+    bool has_board = false;
+    return parse_tokens(line, false, request, has_board, error);
+}
+
+bool parse_request(const std::string& line, solve_request& request, std::string& error) {
+    bool has_board = false;
+    if (!parse_tokens(line, true, request, has_board, error))
+        return false;
+    if (!has_board) {
+        error = "missing board";
+        return false;
+    }
+    return validate_request(request, error);
+}
+
+bool validate_request(const solve_request& request, std::string& error) {
+    int size = request.board.size();
+    if (size != 20 && size != 30 && size != 42) {
+        error = "unsupported board size " + std::to_string(size);
+        return false;
+    }
+    for (char c : request.board) {
+        if (orb_of(c) < 0) {
+            error = std::string("invalid orb ") + c;
+            return false;
+        }
+    }
+    for (int index : request.blocked) {
+        if (index < 0 || index >= size) {
+            error = "blocked cell " + std::to_string(index) + " out of board";
+            return false;
+        }
+    }
+    return true;
+}
+
+solve_response solve_request_with(const solve_request& request,
+                                  workspace& space,
+                                  int threads,
+                                  solution_cache* cache) {
+    auto begin = std::chrono::steady_clock::now();
+    solve_response response;
+    response.id = request.id;
+
+    std::vector<profile> profiles = request.profiles;
+    if (profiles.empty()) {
+        profile combo;
+        combo.name = target_combo;
+        combo.stop_threshold = 100;
+        profiles.push_back(combo);
+    }
+
+    auto s = solver();
+    s.set_workspace(&space);
+    s.set_threads(threads);
+    s.set_cache(cache);
+    s.set_min_erase(request.min_erase);
+    s.set_search_depth(request.search_depth);
+    s.set_beam_size(request.beam_size);
+    s.set_diagonal(request.diagonal);
+    s.set_board(request.board.c_str());
+    s.set_blocked(request.blocked.data(), request.blocked.size());
+    s.set_profiles(profiles.data(), profiles.size());
+
+    search_progress progress;
+    if (request.deadline > 0)
+        progress.set_deadline(begin + std::chrono::milliseconds(request.deadline));
+    s.set_progress(&progress);
+    auto best = s.adventure();
+    auto snapshot = progress.snapshot();
+
+    response.ok = true;
+    response.start = best.step > 0 ? best.begin : -1;
+    response.route = s.get_route_string(best);
+    response.combo = best.combo;
+    response.max_combo = s.max_combo();
+    response.steps = best.step;
+    response.score = best.score;
+    response.goal = best.goal;
+    response.timed_out = snapshot.timed_out;
+    response.cached = s.cached();
+    response.depth = snapshot.depth;
+    response.expanded = snapshot.expanded;
+    response.visited = s.visited_count();
+    response.duplicates = s.duplicate_count();
+    response.ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - begin)
+                      .count();
+    return response;
+}
+
+std::string format_response(const solve_response& response) {
+    std::string id = response.id.empty() ? "-" : response.id;
+    if (!response.ok)
+        return "error id=" + id + " " + response.error;
+
+    // ids and routes have no length limit so only the time goes through a
+    // fixed buffer
+    char ms[32];
+    snprintf(ms, sizeof(ms), "%.3f", response.ms);
+    std::string line = "ok id=" + id;
+    line += " start=" + std::to_string(response.start);
+    line += " route=" + (response.route.empty() ? std::string("-") : response.route);
+    line += " combo=" + std::to_string(response.combo);
+    line += " max=" + std::to_string(response.max_combo);
+    line += " steps=" + std::to_string(response.steps);
+    line += " score=" + std::to_string(response.score);
+    line += " goal=" + std::to_string(response.goal ? 1 : 0);
+    line += " timeout=" + std::to_string(response.timed_out ? 1 : 0);
+    line += " cached=" + std::to_string(response.cached ? 1 : 0);
+    line += " ms=";
+    line += ms;
+    return line;
+}
+
+}  // namespace pazusoba
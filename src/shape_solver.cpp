@@ -1,11 +1,19 @@
+#include <pazusoba/bits.h>
+#include <pazusoba/cache.h>
+#include <pazusoba/evaluate.h>
 #include <pazusoba/shape.h>
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <climits>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <queue>
 #include <sstream>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -17,10 +25,17 @@ const std::array<int, 8> DR{{-1, 1, 0, 0, -1, -1, 1, 1}};
 const std::array<int, 8> DC{{0, 0, -1, 1, -1, 1, -1, 1}};
 const std::array<char, 8> MOVE_NAME{{'U', 'D', 'L', 'R', 'Q', 'E', 'Z', 'C'}};
 
+typedef std::array<bool, MAX_BOARD_LENGTH> cell_mask;
+// directions in the order of DR and DC, letters are only made for the caller
+typedef std::vector<tiny> move_list;
+
 struct Candidate {
     int cost = INF;
     int color = 0;
-    std::vector<int> cells;
+    // owned by shape_placements()
+    const shape_placement* placement = nullptr;
+
+    const std::vector<int>& cells() const { return placement->cells; }
 };
 
 int pos_of(int row, int col, int cols) {
@@ -39,53 +54,6 @@ bool inside(int row, int col, int rows, int cols) {
     return row >= 0 && row < rows && col >= 0 && col < cols;
 }
 
-std::vector<int> neighbors(int pos, int rows, int cols, bool allow_diagonal) {
-    std::vector<int> out;
-    int row = row_of(pos, cols);
-    int col = col_of(pos, cols);
-    int direction_count = allow_diagonal ? 8 : 4;
-    for (int i = 0; i < direction_count; ++i) {
-        int nr = row + DR[i];
-        int nc = col + DC[i];
-        if (inside(nr, nc, rows, cols))
-            out.push_back(pos_of(nr, nc, cols));
-    }
-    return out;
-}
-
-char move_char(int from, int to, int cols) {
-    int dr = row_of(to, cols) - row_of(from, cols);
-    int dc = col_of(to, cols) - col_of(from, cols);
-    for (int i = 0; i < 8; ++i) {
-        if (DR[i] == dr && DC[i] == dc)
-            return MOVE_NAME[i];
-    }
-    return '?';
-}
-
-int apply_move(int pos, char move, int cols) {
-    switch (move) {
-        case 'U':
-            return pos - cols;
-        case 'D':
-            return pos + cols;
-        case 'L':
-            return pos - 1;
-        case 'R':
-            return pos + 1;
-        case 'Q':
-            return pos - cols - 1;
-        case 'E':
-            return pos - cols + 1;
-        case 'Z':
-            return pos + cols - 1;
-        case 'C':
-            return pos + cols + 1;
-        default:
-            return pos;
-    }
-}
-
 bool has_color_filter(const shape_request& request) {
     for (int i = 0; i < ORB_COUNT; ++i) {
         if (request.colors[i])
@@ -104,89 +72,157 @@ bool color_allowed(const shape_request& request, int color, bool prefer_pass) {
     return true;
 }
 
-int assign_cost_for_cells(const std::string& board,
-                          int rows,
-                          int cols,
-                          int color,
-                          const std::vector<int>& cells,
-                          const std::array<bool, MAX_BOARD_LENGTH>& blocked) {
-    (void)rows;
-    std::vector<int> targets;
-    std::vector<int> orbs;
-    std::vector<bool> target_mask(board.size(), false);
-    for (int cell : cells) {
-        target_mask[cell] = true;
-        if (blocked[cell]) {
-            if (board[cell] != ORB_WEB_NAME[color])
-                return INF;
-            continue;
+// Least steps to move an orb between two cells, kept for the last board
+// size seen by the thread. Diagonal moves take one step for both axes
+class distance_table {
+    int ROWS = 0;
+    int COLS = 0;
+    bool DIAGONAL = false;
+    std::array<std::array<tiny, MAX_BOARD_LENGTH>, MAX_BOARD_LENGTH> STEPS;
+
+public:
+    void prepare(int rows, int cols, bool diagonal) {
+        if (rows == ROWS && cols == COLS && diagonal == DIAGONAL)
+            return;
+        ROWS = rows;
+        COLS = cols;
+        DIAGONAL = diagonal;
+        for (int a = 0; a < rows * cols; ++a) {
+            for (int b = 0; b < rows * cols; ++b) {
+                int dr = std::abs(row_of(a, cols) - row_of(b, cols));
+                int dc = std::abs(col_of(a, cols) - col_of(b, cols));
+                STEPS[a][b] = diagonal ? std::max(dr, dc) : dr + dc;
+            }
         }
-        targets.push_back(cell);
     }
-    for (int i = 0; i < (int)board.size(); ++i) {
-        if (blocked[i] || board[i] != ORB_WEB_NAME[color])
-            continue;
-        orbs.push_back(i);
-    }
-    if (orbs.size() < targets.size())
-        return INF;
-    if (targets.empty())
-        return 0;
 
-    int full = 1 << targets.size();
-    std::vector<int> dp(full, INF);
-    dp[0] = 0;
-    for (int orb_pos : orbs) {
-        std::vector<int> next = dp;
-        for (int mask = 0; mask < full; ++mask) {
-            if (dp[mask] >= INF)
-                continue;
-            for (int j = 0; j < (int)targets.size(); ++j) {
-                if (mask & (1 << j))
+    int operator()(int a, int b) const { return STEPS[a][b]; }
+};
+
+// the table of the thread for the board size
+const distance_table& distances_for(int rows, int cols, bool diagonal) {
+    thread_local distance_table table;
+    table.prepare(rows, cols, diagonal);
+    return table;
+}
+
+// Cheapest way to give every target a different orb, the Hungarian method
+// with potentials. cost(i, j) is target i taking orb j, targets <= orbs
+template <typename Cost>
+int min_cost_assignment(int targets, int orbs, const Cost& cost) {
+    // 1 based as the column 0 is the unassigned one
+    std::array<int, MAX_BOARD_LENGTH + 1> u{};
+    std::array<int, MAX_BOARD_LENGTH + 1> v{};
+    std::array<int, MAX_BOARD_LENGTH + 1> owner{};
+    std::array<int, MAX_BOARD_LENGTH + 1> way{};
+    std::array<int, MAX_BOARD_LENGTH + 1> least;
+    std::array<bool, MAX_BOARD_LENGTH + 1> used;
+    for (int i = 1; i <= targets; ++i) {
+        owner[0] = i;
+        int j0 = 0;
+        std::fill(least.begin(), least.begin() + orbs + 1, INF);
+        std::fill(used.begin(), used.begin() + orbs + 1, false);
+        do {
+            used[j0] = true;
+            int i0 = owner[j0];
+            int delta = INF;
+            int j1 = 0;
+            for (int j = 1; j <= orbs; ++j) {
+                if (used[j])
                     continue;
-                int dist = std::abs(row_of(orb_pos, cols) - row_of(targets[j], cols)) +
-                           std::abs(col_of(orb_pos, cols) - col_of(targets[j], cols));
-                int nmask = mask | (1 << j);
-                next[nmask] = std::min(next[nmask], dp[mask] + dist);
+                int current = cost(i0 - 1, j - 1) - u[i0] - v[j];
+                if (current < least[j]) {
+                    least[j] = current;
+                    way[j] = j0;
+                }
+                if (least[j] < delta) {
+                    delta = least[j];
+                    j1 = j;
+                }
             }
-        }
-        dp.swap(next);
+            for (int j = 0; j <= orbs; ++j) {
+                if (used[j]) {
+                    u[owner[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    least[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (owner[j0] != 0);
+        do {
+            int j1 = way[j0];
+            owner[j0] = owner[j1];
+            j0 = j1;
+        } while (j0 != 0);
     }
-    return dp[full - 1];
+    return -v[0];
 }
 
-bool isolated_enough(const std::string& board,
-                     int rows,
-                     int cols,
-                     int color,
-                     const std::vector<int>& cells) {
-    std::vector<bool> in_shape(board.size(), false);
-    for (int cell : cells)
-        in_shape[cell] = true;
+// Steps from every cell to every orb of a colour, placements overlap so a
+// row is worked out once and shared by all the placements using the cell
+struct colour_costs {
+    std::array<int, MAX_BOARD_LENGTH> orbs;
+    int orb_count = 0;
+    std::array<std::array<tiny, MAX_BOARD_LENGTH>, MAX_BOARD_LENGTH> steps;
+
+    void prepare(const game_board& board,
+                 int size,
+                 int color,
+                 const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                 const distance_table& distances) {
+        orb_count = 0;
+        for (int i = 0; i < size; ++i) {
+            if (!blocked[i] && board[i] == color)
+                orbs[orb_count++] = i;
+        }
+        for (int cell = 0; cell < size; ++cell) {
+            for (int k = 0; k < orb_count; ++k)
+                steps[cell][k] = distances(cell, orbs[k]);
+        }
+    }
+};
+
+int assign_cost_for_cells(const game_board& board,
+                          int color,
+                          const std::vector<int>& cells,
+                          const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                          const colour_costs& costs) {
+    std::array<int, MAX_BOARD_LENGTH> targets;
+    int target_count = 0;
     for (int cell : cells) {
-        for (int next : neighbors(cell, rows, cols, false)) {
-            if (!in_shape[next] && board[next] == ORB_WEB_NAME[color])
-                return false;
+        if (blocked[cell]) {
+            if (board[cell] != color)
+                return INF;
+            continue;
         }
+        targets[target_count++] = cell;
     }
-    return true;
+    if (costs.orb_count < target_count)
+        return INF;
+    if (target_count == 0)
+        return 0;
+    return min_cost_assignment(target_count, costs.orb_count, [&](int i, int j) {
+        return (int)costs.steps[targets[i]][j];
+    });
 }
 
-std::vector<Candidate> ranked_candidates(const std::string& board,
+std::vector<Candidate> ranked_candidates(const game_board& board,
                                          int rows,
                                          int cols,
                                          const shape_request& request,
                                          const std::array<bool, MAX_BOARD_LENGTH>& blocked,
                                          bool prefer_pass) {
     shape_template templ = make_shape_template(request.shape);
+    const auto& placements = shape_placements(request.shape, rows, cols);
+    const auto& distances = distances_for(rows, cols, request.allow_diagonal);
+    // large enough to be kept by the thread as well
+    thread_local colour_costs costs;
     std::array<int, ORB_COUNT> counts{};
-    for (char ch : board) {
-        for (int color = 1; color < ORB_COUNT; ++color) {
-            if (ch == ORB_WEB_NAME[color]) {
-                counts[color]++;
-                break;
-            }
-        }
+    std::array<unsigned long long int, ORB_COUNT> colour_mask{};
+    for (int i = 0; i < rows * cols; ++i) {
+        counts[board[i]]++;
+        colour_mask[board[i]] |= 1ULL << i;
     }
 
     std::vector<Candidate> out;
@@ -195,18 +231,20 @@ std::vector<Candidate> ranked_candidates(const std::string& board,
             continue;
         if (counts[color] < templ.orb_count(rows, cols))
             continue;
-        for (const auto& cells : templ.placements(rows, cols)) {
-            int cost = assign_cost_for_cells(board, rows, cols, color, cells, blocked);
+        costs.prepare(board, rows * cols, color, blocked, distances);
+        for (const auto& placement : placements) {
+            int cost = assign_cost_for_cells(board, color, placement.cells, blocked, costs);
             if (cost >= INF)
                 continue;
+            // a shape already on the board has to stand apart from its colour
             if (request.strict_isolation && cost == 0 &&
-                !isolated_enough(board, rows, cols, color, cells)) {
+                (placement.border & colour_mask[color]) != 0) {
                 continue;
             }
             Candidate candidate;
             candidate.cost = cost;
             candidate.color = color;
-            candidate.cells = cells;
+            candidate.placement = &placement;
             out.push_back(candidate);
         }
     }
@@ -218,18 +256,222 @@ std::vector<Candidate> ranked_candidates(const std::string& board,
     return out;
 }
 
-int pick_nearest_free_orb(const std::string& board,
+// Searches of the constructive solver reuse these buffers, states are
+// numbered from the orb and finger cells and marked with the generation of
+// the search which saw them so nothing is cleared between searches
+class bfs_workspace {
+    int ROWS = 0;
+    int COLS = 0;
+    bool DIAGONAL = false;
+    // cells next to every cell and the direction to them
+    std::array<std::array<tiny, DIRECTION_COUNT>, MAX_BOARD_LENGTH> NEXT;
+    std::array<std::array<tiny, DIRECTION_COUNT>, MAX_BOARD_LENGTH> DIRECTION;
+    std::array<int, MAX_BOARD_LENGTH> NEXT_COUNT;
+    // added to a cell to move the finger in a direction, and the direction
+    // which moves it back
+    std::array<int, DIRECTION_COUNT> OFFSET;
+    std::array<tiny, DIRECTION_COUNT> OPPOSITE;
+
+    std::vector<unsigned int> STAMP;
+    std::vector<int> PARENT;
+    std::vector<tiny> MOVE;
+    // every state is queued at most once so the ring never overflows
+    std::vector<int> QUEUE;
+    int CAPACITY = 0;
+    int HEAD = 0;
+    int TAIL = 0;
+    unsigned int GENERATION = 0;
+
+    // meet() searches from the start (side 0) and the goals (side 1) a
+    // layer at a time. States of the goal side point to the state nearer
+    // the goal and keep the move towards it
+    std::vector<tiny> SIDE;
+    std::vector<int> DEPTH;
+    std::array<std::vector<int>, 2> FRONTIER;
+    std::vector<int> LAYER;
+    // the move from a state of the start side to one of the goal side
+    int MEET_START = -1;
+    int MEET_GOAL = -1;
+    int MEET_MOVE = -1;
+
+    void mark(int id, int parent, int direction, int side, int depth) {
+        STAMP[id] = GENERATION;
+        PARENT[id] = parent;
+        MOVE[id] = direction;
+        SIDE[id] = side;
+        DEPTH[id] = depth;
+    }
+
+    // play the moves from the end of the route on the board
+    void play(size_t begin, game_board& board, int& finger, const move_list& route) const {
+        for (size_t i = begin; i < route.size(); ++i) {
+            int next = finger + OFFSET[route[i]];
+            std::swap(board[finger], board[next]);
+            finger = next;
+        }
+    }
+
+public:
+    void prepare(int rows, int cols, bool diagonal) {
+        if (rows == ROWS && cols == COLS && diagonal == DIAGONAL)
+            return;
+        ROWS = rows;
+        COLS = cols;
+        DIAGONAL = diagonal;
+        int direction_count = diagonal ? 8 : 4;
+        for (int i = 0; i < DIRECTION_COUNT; ++i) {
+            OFFSET[i] = DR[i] * cols + DC[i];
+            for (int j = 0; j < DIRECTION_COUNT; ++j) {
+                if (DR[j] == -DR[i] && DC[j] == -DC[i])
+                    OPPOSITE[i] = j;
+            }
+        }
+        for (int pos = 0; pos < rows * cols; ++pos) {
+            NEXT_COUNT[pos] = 0;
+            for (int i = 0; i < direction_count; ++i) {
+                int nr = row_of(pos, cols) + DR[i];
+                int nc = col_of(pos, cols) + DC[i];
+                if (!inside(nr, nc, rows, cols))
+                    continue;
+                NEXT[pos][NEXT_COUNT[pos]] = pos_of(nr, nc, cols);
+                DIRECTION[pos][NEXT_COUNT[pos]] = i;
+                NEXT_COUNT[pos]++;
+            }
+        }
+    }
+
+    // start a new search over this many states
+    void reset(int states) {
+        if (states > CAPACITY) {
+            CAPACITY = states;
+            STAMP.assign(states, 0);
+            PARENT.resize(states);
+            MOVE.resize(states);
+            QUEUE.resize(states);
+            SIDE.resize(states);
+            DEPTH.resize(states);
+            GENERATION = 0;
+        }
+        if (++GENERATION == 0) {
+            std::fill(STAMP.begin(), STAMP.end(), 0);
+            GENERATION = 1;
+        }
+        HEAD = TAIL = 0;
+        FRONTIER[1].clear();
+    }
+
+    int next_count(int pos) const { return NEXT_COUNT[pos]; }
+    int offset(int direction) const { return OFFSET[direction]; }
+    int next(int pos, int i) const { return NEXT[pos][i]; }
+    int direction(int pos, int i) const { return DIRECTION[pos][i]; }
+
+    bool seen(int id) const { return STAMP[id] == GENERATION; }
+    void visit(int id, int parent, int direction) {
+        STAMP[id] = GENERATION;
+        PARENT[id] = parent;
+        MOVE[id] = direction;
+        QUEUE[TAIL] = id;
+        TAIL = (TAIL + 1) % CAPACITY;
+    }
+    bool empty() const { return HEAD == TAIL; }
+    int pop() {
+        int id = QUEUE[HEAD];
+        HEAD = (HEAD + 1) % CAPACITY;
+        return id;
+    }
+
+    // append the moves from the start to the state and play them
+    void follow(int start, int id, game_board& board, int& finger, move_list& route) const {
+        size_t begin = route.size();
+        for (; id != start; id = PARENT[id])
+            route.push_back(MOVE[id]);
+        std::reverse(route.begin() + begin, route.end());
+        play(begin, board, finger, route);
+    }
+
+    // a state the search back starts from, after reset()
+    void add_goal(int id) {
+        if (seen(id))
+            return;
+        mark(id, id, 0, 1, 0);
+        FRONTIER[1].push_back(id);
+    }
+
+    // Breadth first from the start and back from the goals at once, always
+    // a whole layer of the smaller side. A move undoes itself so the goal
+    // side searches with the same moves, expand(id, visit) calls
+    // visit(next, direction) for every move. When the sides meet the rest
+    // of the layer is checked for a shorter route. Either side running out
+    // of states means there is no route, which is where a search from the
+    // start alone would go through everything it can reach
+    template <typename Expand>
+    bool meet(int start, const Expand& expand) {
+        MEET_START = MEET_GOAL = MEET_MOVE = -1;
+        if (seen(start)) {
+            MEET_START = MEET_GOAL = start;
+            return true;
+        }
+        mark(start, start, 0, 0, 0);
+        FRONTIER[0].assign(1, start);
+        int best = INF;
+        while (!FRONTIER[0].empty() && !FRONTIER[1].empty()) {
+            int side = FRONTIER[0].size() <= FRONTIER[1].size() ? 0 : 1;
+            LAYER.clear();
+            for (int id : FRONTIER[side]) {
+                expand(id, [&](int next, int direction) {
+                    if (!seen(next)) {
+                        mark(next, id, side == 0 ? direction : OPPOSITE[direction], side,
+                             DEPTH[id] + 1);
+                        LAYER.push_back(next);
+                        return;
+                    }
+                    if (SIDE[next] == side || DEPTH[id] + 1 + DEPTH[next] >= best)
+                        return;
+                    best = DEPTH[id] + 1 + DEPTH[next];
+                    MEET_START = side == 0 ? id : next;
+                    MEET_GOAL = side == 0 ? next : id;
+                    MEET_MOVE = side == 0 ? direction : OPPOSITE[direction];
+                });
+            }
+            if (best < INF)
+                return true;
+            FRONTIER[side].swap(LAYER);
+        }
+        return false;
+    }
+
+    // append the moves of the route meet() found and play them
+    void follow_meeting(int start, game_board& board, int& finger, move_list& route) const {
+        size_t begin = route.size();
+        for (int id = MEET_START; id != start; id = PARENT[id])
+            route.push_back(MOVE[id]);
+        std::reverse(route.begin() + begin, route.end());
+        if (MEET_MOVE >= 0)
+            route.push_back(MEET_MOVE);
+        for (int id = MEET_GOAL; PARENT[id] != id; id = PARENT[id])
+            route.push_back(MOVE[id]);
+        play(begin, board, finger, route);
+    }
+};
+
+// buffers of the searches are kept by the thread between calls
+bfs_workspace& workspace_for(int rows, int cols, bool diagonal) {
+    thread_local bfs_workspace space;
+    space.prepare(rows, cols, diagonal);
+    return space;
+}
+
+int pick_nearest_free_orb(const game_board& board,
                           int rows,
                           int cols,
                           int color,
                           int goal,
-                          const std::vector<bool>& locked,
+                          const cell_mask& locked,
                           int finger) {
-    (void)rows;
     int best = -1;
     int best_dist = INF;
-    for (int pos = 0; pos < (int)board.size(); ++pos) {
-        if (locked[pos] || pos == finger || board[pos] != ORB_WEB_NAME[color])
+    for (int pos = 0; pos < rows * cols; ++pos) {
+        if (locked[pos] || pos == finger || board[pos] != color)
             continue;
         int dist = std::abs(row_of(pos, cols) - row_of(goal, cols)) +
                    std::abs(col_of(pos, cols) - col_of(goal, cols));
@@ -241,157 +483,156 @@ int pick_nearest_free_orb(const std::string& board,
     return best;
 }
 
-bool move_orb_bfs(std::string& board,
+bool move_orb_bfs(bfs_workspace& space,
+                  game_board& board,
                   int rows,
                   int cols,
                   int orb_from,
                   int goal,
                   int& finger,
-                  const std::vector<bool>& locked,
-                  bool allow_diagonal,
-                  std::string& route) {
+                  const cell_mask& locked,
+                  bool bidirectional,
+                  move_list& route) {
     if (orb_from == goal)
         return true;
 
+    // the orb and the finger, orb * size + finger
     const int size = rows * cols;
-    struct Node {
-        int orb;
-        int finger;
+    auto expand = [&](int id, const auto& visit) {
+        int orb = id / size;
+        int curr_finger = id % size;
+        for (int i = 0; i < space.next_count(curr_finger); ++i) {
+            int next = space.next(curr_finger, i);
+            if (locked[next])
+                continue;
+            int next_orb = (next == orb) ? curr_finger : orb;
+            visit(next_orb * size + next, space.direction(curr_finger, i));
+        }
     };
+    space.reset(size * size);
+    int start_id = orb_from * size + finger;
 
-    std::vector<int> parent(size * size, -1);
-    std::vector<char> pmove(size * size, '?');
-    auto id_of = [size](int orb, int finger_pos) {
-        return orb * size + finger_pos;
-    };
+    if (bidirectional) {
+        // the orb on the goal, the finger anywhere else
+        for (int pos = 0; pos < size; ++pos) {
+            if (pos != goal && !locked[pos])
+                space.add_goal(goal * size + pos);
+        }
+        if (!space.meet(start_id, expand))
+            return false;
+        space.follow_meeting(start_id, board, finger, route);
+        return true;
+    }
 
-    std::queue<Node> q;
-    int start_id = id_of(orb_from, finger);
-    parent[start_id] = start_id;
-    q.push({orb_from, finger});
+    space.visit(start_id, start_id, 0);
     int found_id = -1;
-
-    while (!q.empty()) {
-        Node node = q.front();
-        q.pop();
-        if (node.orb == goal) {
-            found_id = id_of(node.orb, node.finger);
+    while (!space.empty()) {
+        int id = space.pop();
+        if (id / size == goal) {
+            found_id = id;
             break;
         }
-        for (int next : neighbors(node.finger, rows, cols, allow_diagonal)) {
-            if (locked[next])
-                continue;
-            int next_orb = (next == node.orb) ? node.finger : node.orb;
-            int nid = id_of(next_orb, next);
-            if (parent[nid] != -1)
-                continue;
-            parent[nid] = id_of(node.orb, node.finger);
-            pmove[nid] = move_char(node.finger, next, cols);
-            q.push({next_orb, next});
-        }
+        expand(id, [&](int nid, int direction) {
+            if (!space.seen(nid))
+                space.visit(nid, id, direction);
+        });
     }
 
     if (found_id < 0)
         return false;
-
-    std::string seq;
-    for (int id = found_id; id != start_id; id = parent[id])
-        seq.push_back(pmove[id]);
-    std::reverse(seq.begin(), seq.end());
-
-    for (char move : seq) {
-        int next = apply_move(finger, move, cols);
-        std::swap(board[finger], board[next]);
-        route.push_back(move);
-        finger = next;
-    }
+    space.follow(start_id, found_id, board, finger, route);
     return true;
 }
 
-bool move_two_orbs_bfs(std::string& board,
+bool move_two_orbs_bfs(bfs_workspace& space,
+                       game_board& board,
                        int rows,
                        int cols,
                        int color,
                        int goal1,
                        int goal2,
                        int& finger,
-                       const std::vector<bool>& locked,
-                       bool allow_diagonal,
-                       std::string& route) {
-    if (board[goal1] == ORB_WEB_NAME[color] && board[goal2] == ORB_WEB_NAME[color])
+                       const cell_mask& locked,
+                       bool bidirectional,
+                       move_list& route) {
+    if (board[goal1] == color && board[goal2] == color)
         return true;
 
     const int size = rows * cols;
-    std::vector<int> orbs;
+    std::array<int, MAX_BOARD_LENGTH> orbs;
+    int orb_count = 0;
     for (int pos = 0; pos < size; ++pos) {
-        if (locked[pos] || pos == finger || board[pos] != ORB_WEB_NAME[color])
+        if (locked[pos] || pos == finger || board[pos] != color)
             continue;
-        orbs.push_back(pos);
+        orbs[orb_count++] = pos;
     }
-    if (orbs.size() < 2)
+    if (orb_count < 2)
         return false;
 
     auto encode = [size](int orb1, int orb2, int finger_pos) {
         return (orb1 * size + orb2) * size + finger_pos;
     };
+    auto expand = [&](int id, const auto& visit) {
+        int curr_finger = id % size;
+        int tmp = id / size;
+        int orb2 = tmp % size;
+        int orb1 = tmp / size;
+        for (int i = 0; i < space.next_count(curr_finger); ++i) {
+            int next = space.next(curr_finger, i);
+            if (locked[next])
+                continue;
+            int next_orb1 = (next == orb1) ? curr_finger : orb1;
+            int next_orb2 = (next == orb2) ? curr_finger : orb2;
+            if (next_orb1 == next_orb2)
+                continue;
+            visit(encode(next_orb1, next_orb2, next), space.direction(curr_finger, i));
+        }
+    };
 
-    for (size_t a = 0; a < orbs.size(); ++a) {
-        for (size_t b = a + 1; b < orbs.size(); ++b) {
+    for (int a = 0; a < orb_count; ++a) {
+        for (int b = a + 1; b < orb_count; ++b) {
+            space.reset(size * size * size);
             int start_id = encode(orbs[a], orbs[b], finger);
-            std::unordered_map<int, int> parent;
-            std::unordered_map<int, char> pmove;
-            std::queue<int> q;
-            parent[start_id] = start_id;
-            q.push(start_id);
-            int found = -1;
 
-            while (!q.empty()) {
-                int id = q.front();
-                q.pop();
-                int curr_finger = id % size;
+            if (bidirectional) {
+                // both orbs on the goals either way round, the finger
+                // anywhere else
+                for (int pos = 0; pos < size; ++pos) {
+                    if (pos == goal1 || pos == goal2 || locked[pos])
+                        continue;
+                    space.add_goal(encode(goal1, goal2, pos));
+                    space.add_goal(encode(goal2, goal1, pos));
+                }
+                if (!space.meet(start_id, expand))
+                    continue;
+                space.follow_meeting(start_id, board, finger, route);
+                return board[goal1] == color && board[goal2] == color;
+            }
+
+            space.visit(start_id, start_id, 0);
+            int found = -1;
+            while (!space.empty()) {
+                int id = space.pop();
                 int tmp = id / size;
                 int orb2 = tmp % size;
                 int orb1 = tmp / size;
-
                 bool done = (orb1 == goal1 && orb2 == goal2) ||
                             (orb1 == goal2 && orb2 == goal1);
                 if (done) {
                     found = id;
                     break;
                 }
-
-                for (int next : neighbors(curr_finger, rows, cols, allow_diagonal)) {
-                    if (locked[next])
-                        continue;
-                    int next_orb1 = (next == orb1) ? curr_finger : orb1;
-                    int next_orb2 = (next == orb2) ? curr_finger : orb2;
-                    if (next_orb1 == next_orb2)
-                        continue;
-                    int nid = encode(next_orb1, next_orb2, next);
-                    if (parent.find(nid) != parent.end())
-                        continue;
-                    parent[nid] = id;
-                    pmove[nid] = move_char(curr_finger, next, cols);
-                    q.push(nid);
-                }
+                expand(id, [&](int nid, int direction) {
+                    if (!space.seen(nid))
+                        space.visit(nid, id, direction);
+                });
             }
 
             if (found < 0)
                 continue;
 
-            std::string seq;
-            for (int id = found; id != start_id; id = parent[id])
-                seq.push_back(pmove[id]);
-            std::reverse(seq.begin(), seq.end());
-
-            for (char move : seq) {
-                int next = apply_move(finger, move, cols);
-                std::swap(board[finger], board[next]);
-                route.push_back(move);
-                finger = next;
-            }
-            return board[goal1] == ORB_WEB_NAME[color] &&
-                   board[goal2] == ORB_WEB_NAME[color];
+            space.follow(start_id, found, board, finger, route);
+            return board[goal1] == color && board[goal2] == color;
         }
     }
     return false;
@@ -414,63 +655,118 @@ std::vector<std::vector<int>> make_orders(int count) {
     return orders;
 }
 
-bool run_constructive_for_candidate(std::string& board,
+// The best result of the candidates tried so far, shared by the threads.
+// Results are packed so they are compared and replaced at once, lower is
+// better: combos short of the most the board can make, then steps, then
+// the rank of the candidate so ties go to the same one as in order
+class shared_best {
+    int COMBO_BOUND;
+    bool FIRST_FEASIBLE;
+    std::atomic<long long int> BEST{LLONG_MAX};
+
+    long long int key(int combo, int steps, int index) const {
+        return (long long int)std::max(COMBO_BOUND - combo, 0) << 40 |
+               (long long int)steps << 20 | index;
+    }
+
+public:
+    shared_best(int combo_bound, bool first_feasible)
+        : COMBO_BOUND(combo_bound), FIRST_FEASIBLE(first_feasible) {}
+
+    void offer(int combo, int steps, int index) {
+        long long int candidate = key(combo, steps, index);
+        long long int current = BEST.load();
+        while (candidate < current && !BEST.compare_exchange_weak(current, candidate)) {
+        }
+    }
+
+    // false once a candidate with at least these steps can't be the result
+    bool can_win(int steps, int index) const {
+        long long int current = BEST.load(std::memory_order_relaxed);
+        if (FIRST_FEASIBLE)
+            return current == LLONG_MAX;
+        return key(COMBO_BOUND, steps, index) < current;
+    }
+
+    bool found() const { return BEST.load() != LLONG_MAX; }
+};
+
+// The finger starts on an orb of another colour outside the shape if there
+// is one, -1 if every cell is blocked or in the shape
+int pick_start(const game_board& board,
+               int size,
+               const Candidate& target,
+               const std::array<bool, MAX_BOARD_LENGTH>& blocked) {
+    const auto in_shape = [&](int i) { return (target.placement->mask >> i) & 1; };
+    for (int i = 0; i < size; ++i) {
+        if (!blocked[i] && !in_shape(i) && board[i] != target.color)
+            return i;
+    }
+    for (int i = 0; i < size; ++i) {
+        if (!blocked[i] && !in_shape(i))
+            return i;
+    }
+    return -1;
+}
+
+// Every step moves one orb by one cell besides the held one, so the
+// assignment cost bounds the steps. It counts twice if the held orb is
+// of the colour as well
+int step_lower_bound(const game_board& board, const Candidate& target, int start) {
+    if (start >= 0 && board[start] == target.color)
+        return (target.cost + 1) / 2;
+    return target.cost;
+}
+
+bool run_constructive_for_candidate(bfs_workspace& space,
+                                    game_board& board,
                                     int rows,
                                     int cols,
                                     const Candidate& target,
                                     const std::array<bool, MAX_BOARD_LENGTH>& blocked,
-                                    bool allow_diagonal,
+                                    const std::vector<std::vector<int>>& orders,
+                                    bool bidirectional,
+                                    const shared_best& best,
+                                    int index,
                                     int& start_finger,
-                                    std::string& route,
+                                    move_list& route,
                                     std::string& note) {
-    const int size = rows * cols;
-    std::vector<bool> in_shape(size, false);
-    for (int cell : target.cells)
-        in_shape[cell] = true;
-
-    int initial_finger = -1;
-    for (int i = 0; i < size; ++i) {
-        if (!blocked[i] && !in_shape[i] && board[i] != ORB_WEB_NAME[target.color]) {
-            initial_finger = i;
-            break;
-        }
-    }
-    if (initial_finger < 0) {
-        for (int i = 0; i < size; ++i) {
-            if (!blocked[i] && !in_shape[i]) {
-                initial_finger = i;
-                break;
-            }
-        }
-    }
+    int initial_finger = pick_start(board, rows * cols, target, blocked);
     if (initial_finger < 0) {
         note = "no movable start cell";
         return false;
     }
+    int lower_bound = step_lower_bound(board, target, initial_finger);
+    const auto& cells = target.cells();
 
-    for (const auto& order : make_orders((int)target.cells.size())) {
-        std::string attempt = board;
-        std::string attempt_route;
-        int finger = initial_finger;
-        std::vector<bool> locked(size, false);
-        for (int i = 0; i < size; ++i) {
-            if (blocked[i])
-                locked[i] = true;
+    // the route is assigned again for every order so its buffer is kept
+    game_board attempt;
+    move_list attempt_route;
+    for (const auto& order : orders) {
+        // every order takes at least as many steps, another candidate may
+        // have done better while the last order was tried
+        if (!best.can_win(lower_bound, index)) {
+            note = "cannot beat the best candidate";
+            return false;
         }
+        attempt = board;
+        attempt_route.clear();
+        int finger = initial_finger;
+        cell_mask locked = blocked;
 
         bool ok = true;
         for (int oi = 0; oi < (int)order.size(); ++oi) {
             int remaining_missing = 0;
             for (int ri = oi; ri < (int)order.size(); ++ri) {
-                int remaining_goal = target.cells[order[ri]];
-                if (attempt[remaining_goal] != ORB_WEB_NAME[target.color])
+                int remaining_goal = cells[order[ri]];
+                if (attempt[remaining_goal] != target.color)
                     remaining_missing++;
             }
             if (remaining_missing <= 2)
                 break;
 
-            int goal = target.cells[order[oi]];
-            if (attempt[goal] == ORB_WEB_NAME[target.color]) {
+            int goal = cells[order[oi]];
+            if (attempt[goal] == target.color) {
                 locked[goal] = true;
                 continue;
             }
@@ -480,13 +776,13 @@ bool run_constructive_for_candidate(std::string& board,
                 ok = false;
                 break;
             }
-            if (!move_orb_bfs(attempt, rows, cols, orb, goal, finger, locked, allow_diagonal,
-                              attempt_route)) {
+            if (!move_orb_bfs(space, attempt, rows, cols, orb, goal, finger, locked,
+                              bidirectional, attempt_route)) {
                 note = "single-orb BFS blocked";
                 ok = false;
                 break;
             }
-            if (attempt[goal] != ORB_WEB_NAME[target.color]) {
+            if (attempt[goal] != target.color) {
                 note = "single-orb replay failed";
                 ok = false;
                 break;
@@ -496,35 +792,36 @@ bool run_constructive_for_candidate(std::string& board,
         if (!ok)
             continue;
 
-        std::vector<int> missing_goals;
-        for (int index : order) {
-            int goal = target.cells[index];
-            if (attempt[goal] != ORB_WEB_NAME[target.color])
-                missing_goals.push_back(goal);
+        std::array<int, MAX_BOARD_LENGTH> missing_goals;
+        int missing_count = 0;
+        for (int cell : order) {
+            int goal = cells[cell];
+            if (attempt[goal] != target.color)
+                missing_goals[missing_count++] = goal;
         }
 
-        if (missing_goals.size() == 1) {
+        if (missing_count == 1) {
             int goal = missing_goals[0];
             int orb = pick_nearest_free_orb(attempt, rows, cols, target.color, goal, locked, finger);
             if (orb < 0 ||
-                !move_orb_bfs(attempt, rows, cols, orb, goal, finger, locked, allow_diagonal,
-                              attempt_route)) {
+                !move_orb_bfs(space, attempt, rows, cols, orb, goal, finger, locked,
+                              bidirectional, attempt_route)) {
                 note = "final single-orb BFS blocked";
                 continue;
             }
-        } else if (missing_goals.size() >= 2) {
-            int goal1 = missing_goals[missing_goals.size() - 2];
-            int goal2 = missing_goals[missing_goals.size() - 1];
-            if (!move_two_orbs_bfs(attempt, rows, cols, target.color, goal1, goal2, finger,
-                                   locked, allow_diagonal, attempt_route)) {
+        } else if (missing_count >= 2) {
+            int goal1 = missing_goals[missing_count - 2];
+            int goal2 = missing_goals[missing_count - 1];
+            if (!move_two_orbs_bfs(space, attempt, rows, cols, target.color, goal1, goal2,
+                                   finger, locked, bidirectional, attempt_route)) {
                 note = "two-orb BFS blocked";
                 continue;
             }
         }
 
         bool formed = true;
-        for (int cell : target.cells) {
-            if (attempt[cell] != ORB_WEB_NAME[target.color]) {
+        for (int cell : cells) {
+            if (attempt[cell] != target.color) {
                 formed = false;
                 break;
             }
@@ -548,15 +845,696 @@ std::string candidate_note(const Candidate& candidate) {
     return ss.str();
 }
 
-std::pair<int, int> evaluate_combo(const std::string& board) {
-    solver s;
-    s.set_board(board.c_str());
-    auto copy = s.board();
-    state evaluated;
-    s.evaluate(copy, evaluated);
-    return std::make_pair((int)evaluated.combo, s.max_combo());
+bool to_orbs(const std::string& board, game_board& orbs) {
+    orbs.fill(0);
+    for (size_t i = 0; i < board.size(); ++i) {
+        int o = 0;
+        while (o < ORB_COUNT && ORB_WEB_NAME[o] != board[i])
+            ++o;
+        if (o == ORB_COUNT)
+            return false;
+        orbs[i] = o;
+    }
+    return true;
+}
+
+unsigned long long int shape_settings(const shape_request& request, int rows, int cols) {
+    // shapes and beam searches never share an entry
+    unsigned long long int settings = cache_mix(CACHE_SEED, -1);
+    settings = cache_mix(settings, rows);
+    settings = cache_mix(settings, cols);
+    settings = cache_mix(settings, request.shape);
+    settings = cache_mix(settings, request.mode);
+    settings = cache_mix(settings, request.strict_isolation);
+    settings = cache_mix(settings, request.allow_diagonal);
+    settings = cache_mix(settings, request.first_feasible);
+    settings = cache_mix(settings, request.bidirectional);
+    settings = cache_mix(settings, request.search);
+    if (request.search == shape_ida)
+        settings = cache_mix(settings, request.table_entries);
+    if (request.search != shape_constructive) {
+        settings = cache_mix(settings, (long long int)(request.weight * 1000));
+        settings = cache_mix(settings, request.max_steps);
+        settings = cache_mix(settings, request.node_limit);
+    }
+    for (int i = 0; i < ORB_COUNT; ++i)
+        settings = cache_mix(settings, request.colors[i]);
+    return settings;
 }
 
+
+// A route and the board after it before they are turned into letters
+struct shape_found {
+    shape_result result;
+    game_board final_board;
+    move_list route;
+};
+
+bool valid_board(const std::string& board,
+                 int rows,
+                 int cols,
+                 game_board& orbs,
+                 std::string& note) {
+    if ((int)board.size() != rows * cols || board.size() > MAX_BOARD_LENGTH) {
+        note = "invalid board size";
+        return false;
+    }
+    if (!to_orbs(board, orbs)) {
+        note = "invalid orb";
+        return false;
+    }
+    return true;
+}
+
+void to_result(const shape_found& found, int size, shape_result& result) {
+    std::string final_board = result.final_board;
+    result = found.result;
+    result.final_board = final_board;
+    if (!result.success)
+        return;
+    for (tiny direction : found.route)
+        result.route += MOVE_NAME[direction];
+    for (int i = 0; i < size; ++i)
+        result.final_board[i] = ORB_WEB_NAME[found.final_board[i]];
+}
+
+// no board makes more combos than every colour split into threes and
+// routes only move orbs around so the max combo never changes
+void combo_limits(const game_board& board,
+                  int rows,
+                  int cols,
+                  int& combo_bound,
+                  int& max_combo) {
+    const int size = rows * cols;
+    orb_list counts{};
+    for (int i = 0; i < size; ++i)
+        counts[board[i]]++;
+    combo_bound = 0;
+    for (int c = 1; c < ORB_COUNT; ++c)
+        combo_bound += counts[c] / 3;
+    max_combo = estimate_max_combo(counts, rows, cols, 3);
+}
+
+// What the searches by colour know about the shapes of one colour. Other
+// colours never decide whether a goal is reached so a state is only the
+// cells of the colour and the finger, packed into one key
+#define SEARCH_FINGER_SHIFT 48
+#define SEARCH_CELLS ((1ULL << SEARCH_FINGER_SHIFT) - 1)
+
+class colour_goal {
+    const distance_table* DISTANCES = nullptr;
+    // the fewest moves for the finger to put each orb in any target cell
+    std::array<std::array<tiny, MAX_BOARD_LENGTH>, MAX_BOARD_LENGTH> REACH;
+    unsigned long long int BLOCKED = 0;
+    unsigned long long int COLOUR = 0;
+    unsigned long long int TARGET = 0;
+    // cells of the best candidate, blocked ones already have the colour
+    std::array<int, MAX_BOARD_LENGTH> TARGETS;
+    int TARGET_COUNT = 0;
+    std::vector<const shape_placement*> GOALS;
+    bool STRICT = false;
+
+public:
+    void prepare(const game_board& board,
+                 int rows,
+                 int cols,
+                 const Candidate& target,
+                 const std::vector<Candidate>& candidates,
+                 const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                 const shape_request& request) {
+        DISTANCES = &distances_for(rows, cols, request.allow_diagonal);
+        BLOCKED = COLOUR = 0;
+        for (int i = 0; i < rows * cols; ++i) {
+            if (blocked[i])
+                BLOCKED |= 1ULL << i;
+            if (board[i] == target.color)
+                COLOUR |= 1ULL << i;
+        }
+        TARGET = target.placement->mask;
+        const auto& pattern = shape_patterns(rows, cols, request.allow_diagonal);
+        for (int finger = 0; finger < rows * cols; ++finger) {
+            for (int orb = 0; orb < rows * cols; ++orb) {
+                int best = INF;
+                for (int cell : target.cells())
+                    best = std::min(best, pattern(finger, orb, cell));
+                REACH[finger][orb] = best;
+            }
+        }
+        TARGET_COUNT = 0;
+        for (int cell : target.cells()) {
+            if (!blocked[cell])
+                TARGETS[TARGET_COUNT++] = cell;
+        }
+        GOALS.clear();
+        for (const auto& other : candidates) {
+            if (other.color == target.color)
+                GOALS.push_back(other.placement);
+        }
+        STRICT = request.strict_isolation;
+    }
+
+    // cells of the colour on the board
+    unsigned long long int colour_mask() const { return COLOUR; }
+
+    // the cheapest assignment to the best candidate, it only changes when
+    // an orb of the colour moves
+    int fixed(unsigned long long int mask) const {
+        std::array<int, MAX_BOARD_LENGTH> orbs;
+        int orb_count = 0;
+        for (unsigned long long int m = mask & ~BLOCKED; m != 0; m &= m - 1)
+            orbs[orb_count++] = bits::lowest(m);
+        if (orb_count < TARGET_COUNT)
+            return INF;
+        return min_cost_assignment(TARGET_COUNT, orb_count, [&](int i, int j) {
+            return (*DISTANCES)(TARGETS[i], orbs[j]);
+        });
+    }
+
+    // The assignment plus the steps for the finger to get next to an orb
+    // which isn't in place yet. Every empty target needs an orb from
+    // outside, so the slowest of the fastest ones to arrive is a bound too
+    int estimate(unsigned long long int mask, int finger, int fixed) const {
+        std::array<int, MAX_BOARD_LENGTH> reach;
+        int outside = 0;
+        int closest = INF;
+        for (unsigned long long int m = mask & ~TARGET & ~BLOCKED; m != 0; m &= m - 1) {
+            int orb = bits::lowest(m);
+            closest = std::min(closest, (*DISTANCES)(finger, orb));
+            reach[outside++] = REACH[finger][orb];
+        }
+        int h = fixed + (closest == INF ? 0 : std::max(0, closest - 1));
+        int empty = bits::count(TARGET & ~BLOCKED & ~mask);
+        if (empty > 0 && empty <= outside) {
+            std::nth_element(reach.begin(), reach.begin() + empty - 1, reach.begin() + outside);
+            h = std::max(h, reach[empty - 1]);
+        }
+        return h;
+    }
+
+    // any candidate of the colour will do, with strict isolation the shape
+    // also has to stand apart from its colour
+    bool reached(unsigned long long int mask) const {
+        for (auto goal : GOALS) {
+            if ((mask & goal->mask) != goal->mask)
+                continue;
+            if (!STRICT || (mask & goal->border) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+// the held orb swaps with the next one, only the colour of the goal counts
+unsigned long long int swap_cells(unsigned long long int mask, int finger, int next) {
+    if (((mask >> finger) & 1) != ((mask >> next) & 1))
+        mask ^= 1ULL << finger | 1ULL << next;
+    return mask;
+}
+
+// the calling thread does the work alone or with a pool of its own
+void run_workers(int threads, const std::function<void(int)>& task) {
+    if (threads == 1) {
+        task(0);
+        return;
+    }
+    thread_local worker_pool pool;
+    pool.run(threads, task);
+}
+
+// A state of the A* search, kept in one array and linked to its parent
+// instead of copying the route
+struct astar_node {
+    unsigned long long int key;
+    int parent;
+    int steps;
+    // the assignment part of the heuristic
+    int fixed;
+    tiny direction;
+};
+
+// Weighted A* from every start at once, the heuristic is the assignment
+// plus the steps for the finger to reach an orb it still has to move
+bool astar_for_colour(const colour_goal& goal,
+                      int rows,
+                      int cols,
+                      const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                      const shape_request& request,
+                      int& start_finger,
+                      move_list& route,
+                      std::string& note) {
+    auto& space = workspace_for(rows, cols, request.allow_diagonal);
+    // (f, node) packed so the smallest f comes first and ties go to the
+    // older node
+    std::vector<astar_node> nodes;
+    std::priority_queue<unsigned long long int, std::vector<unsigned long long int>,
+                        std::greater<unsigned long long int>>
+        open;
+    std::unordered_map<unsigned long long int, int> best_steps;
+    auto push = [&](const astar_node& node, int h) {
+        long long int f = node.steps + (long long int)(request.weight * h);
+        open.push((unsigned long long int)f << 32 | nodes.size());
+        nodes.push_back(node);
+    };
+
+    const unsigned long long int colour_mask = goal.colour_mask();
+    int fixed = goal.fixed(colour_mask);
+    if (fixed >= INF) {
+        note = "not enough orbs";
+        return false;
+    }
+    for (int start = 0; start < rows * cols; ++start) {
+        if (blocked[start])
+            continue;
+        astar_node root{colour_mask | (unsigned long long int)start << SEARCH_FINGER_SHIFT, -1, 0,
+                        fixed, 0};
+        best_steps[root.key] = 0;
+        push(root, goal.estimate(colour_mask, start, fixed));
+    }
+
+    int expanded = 0;
+    while (!open.empty()) {
+        int id = open.top() & 0xffffffff;
+        open.pop();
+        const astar_node node = nodes[id];
+        unsigned long long int mask = node.key & SEARCH_CELLS;
+        int finger = node.key >> SEARCH_FINGER_SHIFT;
+        if (best_steps[node.key] < node.steps)
+            continue;
+        if (goal.reached(mask)) {
+            route.clear();
+            for (; nodes[id].parent >= 0; id = nodes[id].parent)
+                route.push_back(nodes[id].direction);
+            std::reverse(route.begin(), route.end());
+            start_finger = nodes[id].key >> SEARCH_FINGER_SHIFT;
+            return true;
+        }
+        if (node.steps >= request.max_steps)
+            continue;
+        if (++expanded > request.node_limit) {
+            note = "A* node limit reached";
+            return false;
+        }
+
+        for (int i = 0; i < space.next_count(finger); ++i) {
+            int next = space.next(finger, i);
+            if (blocked[next])
+                continue;
+            unsigned long long int child = swap_cells(mask, finger, next);
+            astar_node next_node{child | (unsigned long long int)next << SEARCH_FINGER_SHIFT, id,
+                                 node.steps + 1, node.fixed, (tiny)space.direction(finger, i)};
+            auto found = best_steps.find(next_node.key);
+            if (found != best_steps.end() && found->second <= next_node.steps)
+                continue;
+            best_steps[next_node.key] = next_node.steps;
+            if (child != mask)
+                next_node.fixed = goal.fixed(child);
+            push(next_node, goal.estimate(child, next, next_node.fixed));
+        }
+    }
+    note = "A* open list exhausted";
+    return false;
+}
+
+// Transpositions of the IDA* search in a fixed number of entries, a new
+// state simply replaces the one in its slot. Entries are stamped with the
+// search which wrote them so nothing is cleared between searches
+class ida_table {
+    struct entry {
+        unsigned long long int key;
+        int steps;
+        unsigned int stamp;
+    };
+    std::vector<entry> ENTRIES;
+    unsigned int STAMP = 0;
+
+public:
+    // the count is rounded down to a power of two
+    void prepare(size_t count) {
+        size_t length = 1;
+        while (length * 2 <= count)
+            length *= 2;
+        if (ENTRIES.size() != length) {
+            ENTRIES.assign(length, entry{0, 0, 0});
+            STAMP = 0;
+        }
+    }
+
+    // forget every state, only the stamp changes
+    void clear() {
+        if (++STAMP == 0) {
+            std::fill(ENTRIES.begin(), ENTRIES.end(), entry{0, 0, 0});
+            STAMP = 1;
+        }
+    }
+
+    // true when the state was reached before with no more steps, its
+    // subtree was searched then
+    bool seen(unsigned long long int key, int steps) {
+        auto& e = ENTRIES[(key * 0x9e3779b97f4a7c15ULL >> 20) & (ENTRIES.size() - 1)];
+        if (e.stamp == STAMP && e.key == key && e.steps <= steps)
+            return true;
+        e = entry{key, steps, STAMP};
+        return false;
+    }
+};
+
+// Depth first search below a bound of f from one start, the memory is the
+// route and the table no matter how long the search takes
+class ida_search {
+    const colour_goal& GOAL;
+    const bfs_workspace& SPACE;
+    const std::array<bool, MAX_BOARD_LENGTH>& BLOCKED;
+    const shape_request& REQUEST;
+    ida_table& TABLE;
+    // expansions of every thread, and the earliest start which succeeded
+    std::atomic<int>& EXPANDED;
+    const std::atomic<int>& WINNER;
+    int INDEX = 0;
+    int BOUND = 0;
+    int NEXT_BOUND = INF;
+    bool LIMITED = false;
+    bool STOPPED = false;
+    move_list PATH;
+
+    // h is worked out by the parent to order the moves
+    bool dfs(unsigned long long int mask, int finger, int previous, int steps, int fixed, int h) {
+        if (GOAL.reached(mask))
+            return true;
+        int f = steps + (int)(REQUEST.weight * h);
+        if (f > BOUND) {
+            NEXT_BOUND = std::min(NEXT_BOUND, f);
+            return false;
+        }
+        if (steps >= REQUEST.max_steps ||
+            TABLE.seen(mask | (unsigned long long int)finger << SEARCH_FINGER_SHIFT, steps)) {
+            return false;
+        }
+        if (++EXPANDED > REQUEST.node_limit)
+            LIMITED = STOPPED = true;
+        // an earlier start already has a route
+        if (WINNER.load(std::memory_order_relaxed) < INDEX)
+            STOPPED = true;
+        if (STOPPED)
+            return false;
+
+        // the most promising move first, the last iteration stops at the
+        // first route
+        std::array<unsigned long long int, DIRECTION_COUNT> order;
+        std::array<int, DIRECTION_COUNT> child_fixed;
+        std::array<int, DIRECTION_COUNT> child_h;
+        int count = 0;
+        for (int i = 0; i < SPACE.next_count(finger); ++i) {
+            int next = SPACE.next(finger, i);
+            // going back undoes the swap
+            if (next == previous || BLOCKED[next])
+                continue;
+            unsigned long long int child = swap_cells(mask, finger, next);
+            child_fixed[i] = child == mask ? fixed : GOAL.fixed(child);
+            child_h[i] = GOAL.estimate(child, next, child_fixed[i]);
+            order[count++] = (unsigned long long int)child_h[i] << 8 | i;
+        }
+        // no more than 8 moves, std::sort trips -Warray-bounds on them
+        for (int k = 1; k < count; ++k) {
+            unsigned long long int key = order[k];
+            int j = k;
+            for (; j > 0 && order[j - 1] > key; --j)
+                order[j] = order[j - 1];
+            order[j] = key;
+        }
+        for (int k = 0; k < count; ++k) {
+            int i = order[k] & 0xff;
+            int next = SPACE.next(finger, i);
+            PATH.push_back((tiny)SPACE.direction(finger, i));
+            if (dfs(swap_cells(mask, finger, next), next, finger, steps + 1, child_fixed[i],
+                    child_h[i])) {
+                return true;
+            }
+            PATH.pop_back();
+            if (STOPPED)
+                return false;
+        }
+        return false;
+    }
+
+public:
+    ida_search(const colour_goal& goal,
+               const bfs_workspace& space,
+               const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+               const shape_request& request,
+               ida_table& table,
+               std::atomic<int>& expanded,
+               const std::atomic<int>& winner)
+        : GOAL(goal),
+          SPACE(space),
+          BLOCKED(blocked),
+          REQUEST(request),
+          TABLE(table),
+          EXPANDED(expanded),
+          WINNER(winner) {}
+
+    bool run(int index, int start, int bound, int fixed) {
+        INDEX = index;
+        BOUND = bound;
+        NEXT_BOUND = INF;
+        STOPPED = false;
+        PATH.clear();
+        TABLE.clear();
+        return dfs(GOAL.colour_mask(), start, -1, 0, fixed,
+                   GOAL.estimate(GOAL.colour_mask(), start, fixed));
+    }
+
+    // the smallest f above the bound, the bound of the next iteration
+    int next_bound() const { return NEXT_BOUND; }
+    bool limited() const { return LIMITED; }
+    const move_list& path() const { return PATH; }
+};
+
+// Iterative deepening A* with the heuristic of the A* search, memory stays
+// within the table however hard the board is. Starts are split over the
+// threads and the earliest one with a route wins so every run agrees
+bool ida_for_colour(const colour_goal& goal,
+                    int rows,
+                    int cols,
+                    const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                    const shape_request& request,
+                    int& start_finger,
+                    move_list& route,
+                    std::string& note) {
+    const unsigned long long int colour_mask = goal.colour_mask();
+    int fixed = goal.fixed(colour_mask);
+    if (fixed >= INF) {
+        note = "not enough orbs";
+        return false;
+    }
+    std::vector<int> starts;
+    int bound = INF;
+    for (int start = 0; start < rows * cols; ++start) {
+        if (blocked[start])
+            continue;
+        starts.push_back(start);
+        bound = std::min(bound, (int)(request.weight * goal.estimate(colour_mask, start, fixed)));
+    }
+    int count = (int)starts.size();
+    int threads = request.threads > 0 ? request.threads : default_thread_count();
+    threads = std::max(1, std::min(threads, count));
+    // the threads share the memory of the table, each thread keeps its part
+    // for every bound and it is freed when the search returns
+    size_t entries = std::max(1, request.table_entries / threads);
+    std::vector<ida_table> tables(threads);
+
+    std::atomic<int> expanded{0};
+    std::vector<move_list> routes(count);
+    std::vector<int> next_bounds(count);
+    while (bound < INF) {
+        std::atomic<int> winner{INT_MAX};
+        std::atomic<int> next{0};
+        std::atomic<bool> limited{false};
+        run_workers(threads, [&](int thread) {
+            auto& table = tables[thread];
+            table.prepare(entries);
+            ida_search search(goal, workspace_for(rows, cols, request.allow_diagonal), blocked,
+                              request, table, expanded, winner);
+            for (int i = next++; i < count && winner.load() > i; i = next++) {
+                bool found = search.run(i, starts[i], bound, fixed);
+                next_bounds[i] = search.next_bound();
+                if (!found)
+                    continue;
+                routes[i] = search.path();
+                // the earliest start wins, later ones stop at their next state
+                int w = winner.load();
+                while (i < w && !winner.compare_exchange_weak(w, i))
+                    continue;
+            }
+            if (search.limited())
+                limited = true;
+        });
+
+        int won = winner.load();
+        if (won < count) {
+            start_finger = starts[won];
+            route = std::move(routes[won]);
+            return true;
+        }
+        if (limited) {
+            note = "IDA* node limit reached";
+            return false;
+        }
+        bound = *std::min_element(next_bounds.begin(), next_bounds.end());
+    }
+    note = "IDA* bound exhausted";
+    return false;
+}
+
+// Search every colour the candidates have in the order of their best
+// candidate, the first route found is the result
+shape_found route_by_colour(const game_board& board,
+                            int rows,
+                            int cols,
+                            const shape_request& request,
+                            const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                            const std::vector<Candidate>& candidates) {
+    shape_found found;
+    found.result.note = "no candidate tried";
+    int combo_bound, max_combo;
+    combo_limits(board, rows, cols, combo_bound, max_combo);
+
+    bool tried[ORB_COUNT]{false};
+    colour_goal goal;
+    for (const auto& target : candidates) {
+        if (tried[target.color])
+            continue;
+        tried[target.color] = true;
+        goal.prepare(board, rows, cols, target, candidates, blocked, request);
+
+        int start = -1;
+        bool routed = request.search == shape_ida
+                          ? ida_for_colour(goal, rows, cols, blocked, request, start,
+                                           found.route, found.result.note)
+                          : astar_for_colour(goal, rows, cols, blocked, request, start,
+                                             found.route, found.result.note);
+        if (!routed)
+            continue;
+        found.final_board = board;
+        auto& space = workspace_for(rows, cols, request.allow_diagonal);
+        int finger = start;
+        for (tiny direction : found.route) {
+            int next = finger + space.offset(direction);
+            std::swap(found.final_board[finger], found.final_board[next]);
+            finger = next;
+        }
+
+        auto& r = found.result;
+        r.success = true;
+        r.steps = (int)found.route.size();
+        r.start = start;
+        r.color = target.color;
+        r.combo = evaluate_board(found.final_board, rows, cols, 3).combo;
+        r.max_combo = max_combo;
+        std::ostringstream ss;
+        ss << (request.search == shape_ida ? "ida" : "weighted-astar")
+           << " color=" << ORB_WEB_NAME[target.color] << " cost=" << target.cost;
+        r.note = ss.str();
+        return found;
+    }
+    return found;
+}
+
+shape_found solve_orbs(const game_board& board,
+                       int rows,
+                       int cols,
+                       const shape_request& request,
+                       const std::array<bool, MAX_BOARD_LENGTH>& blocked) {
+    shape_found failed;
+    std::vector<Candidate> candidates;
+    if (request.mode == color_prefer && has_color_filter(request)) {
+        candidates = ranked_candidates(board, rows, cols, request, blocked, true);
+        if (candidates.empty())
+            candidates = ranked_candidates(board, rows, cols, request, blocked, false);
+    } else {
+        candidates = ranked_candidates(board, rows, cols, request, blocked, false);
+    }
+
+    if (candidates.empty()) {
+        failed.result.note = "no feasible candidate";
+        return failed;
+    }
+
+    if (request.search == shape_astar || request.search == shape_ida)
+        return route_by_colour(board, rows, cols, request, blocked, candidates);
+
+    // every placement of a shape has the same number of cells
+    auto orders = make_orders((int)candidates[0].cells().size());
+    // blocked orbs still count as the evaluation doesn't know them
+    int combo_bound, max_combo;
+    combo_limits(board, rows, cols, combo_bound, max_combo);
+
+    // candidates are sorted by cost, later ones are given up as soon as
+    // they can't do better than the best one so far
+    int limit = (int)candidates.size();
+    shared_best shared(combo_bound, request.first_feasible);
+    std::atomic<int> next{0};
+    std::vector<shape_found> found(limit);
+    std::vector<std::string> notes(limit, "no candidate tried");
+    auto explore = [&](int) {
+        // buffers of the searches are kept by the thread between calls
+        auto& space = workspace_for(rows, cols, request.allow_diagonal);
+        for (int i = next++; i < limit; i = next++) {
+            if (request.first_feasible && shared.found())
+                break;
+            auto& f = found[i];
+            f.final_board = board;
+            int start = -1;
+            if (!run_constructive_for_candidate(space, f.final_board, rows, cols, candidates[i],
+                                                blocked, orders, request.bidirectional, shared,
+                                                i, start, f.route, notes[i])) {
+                continue;
+            }
+            auto& r = f.result;
+            r.success = true;
+            r.steps = (int)f.route.size();
+            r.start = start;
+            r.color = candidates[i].color;
+            r.combo = evaluate_board(f.final_board, rows, cols, 3).combo;
+            r.max_combo = max_combo;
+            r.note = candidate_note(candidates[i]);
+            shared.offer(r.combo, r.steps, i);
+        }
+    };
+
+    int threads = request.threads > 0 ? request.threads : default_thread_count();
+    threads = std::max(1, std::min(threads, limit));
+    run_workers(threads, explore);
+
+    // the same choice as trying them in order, the most combos then the
+    // fewest steps then the earliest candidate
+    int best = -1;
+    for (int i = 0; i < limit; ++i) {
+        const auto& r = found[i].result;
+        if (!r.success)
+            continue;
+        if (best >= 0 && (r.combo < found[best].result.combo ||
+                          (r.combo == found[best].result.combo &&
+                           r.steps >= found[best].result.steps))) {
+            continue;
+        }
+        best = i;
+        // any route does in this mode
+        if (request.first_feasible)
+            break;
+    }
+
+    if (best >= 0) {
+        found[best].result.note +=
+            request.first_feasible ? " first-feasible" : " combo-optimized";
+        return std::move(found[best]);
+    }
+
+    // the last candidate which was tried, as if they were tried in order
+    failed.result.note = notes[limit - 1];
+    return failed;
+}
+
+
 }  // namespace
 
 std::vector<std::vector<int>> shape_template::placements(int rows, int cols) const {
@@ -615,26 +1593,105 @@ shape_template make_shape_template(int kind) {
     return templ;
 }
 
+const std::vector<shape_placement>& shape_placements(int kind, int rows, int cols) {
+    // (kind, rows, cols) -> placements, never removed so references stay valid
+    static std::mutex placements_mutex;
+    static std::map<std::tuple<int, int, int>, std::vector<shape_placement>> placements_table;
+
+    std::lock_guard<std::mutex> lock(placements_mutex);
+    auto key = std::make_tuple(kind, rows, cols);
+    auto it = placements_table.find(key);
+    if (it != placements_table.end())
+        return it->second;
+
+    auto& table = placements_table[key];
+    for (const auto& cells : make_shape_template(kind).placements(rows, cols)) {
+        shape_placement placement;
+        placement.cells = cells;
+        for (int cell : cells)
+            placement.mask |= 1ULL << cell;
+        for (int cell : cells) {
+            int row = row_of(cell, cols);
+            int col = col_of(cell, cols);
+            for (int i = 0; i < 4; ++i) {
+                if (inside(row + DR[i], col + DC[i], rows, cols))
+                    placement.border |= 1ULL << pos_of(row + DR[i], col + DC[i], cols);
+            }
+        }
+        placement.border &= ~placement.mask;
+        table.push_back(placement);
+    }
+    return table;
+}
+
+const shape_pattern& shape_patterns(int rows, int cols, bool diagonal) {
+    // (rows, cols, diagonal) -> pattern, never removed like the placements
+    static std::mutex patterns_mutex;
+    static std::map<std::tuple<int, int, bool>, shape_pattern> patterns_table;
+
+    std::lock_guard<std::mutex> lock(patterns_mutex);
+    auto key = std::make_tuple(rows, cols, diagonal);
+    auto it = patterns_table.find(key);
+    if (it != patterns_table.end())
+        return it->second;
+
+    auto& pattern = patterns_table[key];
+    const int size = rows * cols;
+    pattern.size = size;
+    pattern.steps.assign(size * size * size, UCHAR_MAX);
+    // states are (orb, finger). A move undoes itself so searching back from
+    // the orb on the target with the finger anywhere gives every start
+    std::vector<int> queue(size * size);
+    for (int target = 0; target < size; ++target) {
+        unsigned char* steps = &pattern.steps[target * size * size];
+        int head = 0, tail = 0;
+        for (int finger = 0; finger < size; ++finger) {
+            steps[target * size + finger] = 0;
+            queue[tail++] = target * size + finger;
+        }
+        while (head < tail) {
+            int state = queue[head++];
+            int orb = state / size;
+            int finger = state % size;
+            for (int i = 0; i < (diagonal ? 8 : 4); ++i) {
+                int row = row_of(finger, cols) + DR[i];
+                int col = col_of(finger, cols) + DC[i];
+                if (!inside(row, col, rows, cols))
+                    continue;
+                int next = pos_of(row, col, cols);
+                // the held orb follows the finger, the one stepped on
+                // takes its place
+                int moved = orb == finger ? next : (orb == next ? finger : orb);
+                int next_state = moved * size + next;
+                if (steps[next_state] != UCHAR_MAX)
+                    continue;
+                steps[next_state] = steps[state] + 1;
+                queue[tail++] = next_state;
+            }
+        }
+    }
+    return pattern;
+}
+
 bool board_has_shape(const std::string& board,
                      int rows,
                      int cols,
                      int kind,
                      char* color) {
-    shape_template templ = make_shape_template(kind);
-    for (const auto& cells : templ.placements(rows, cols)) {
-        if (cells.empty())
+    if ((int)board.size() < rows * cols || rows * cols > MAX_BOARD_LENGTH)
+        return false;
+    // cells of every letter on the board
+    std::array<unsigned long long int, 256> letter_mask{};
+    for (int i = 0; i < rows * cols; ++i)
+        letter_mask[(unsigned char)board[i]] |= 1ULL << i;
+
+    for (const auto& placement : shape_placements(kind, rows, cols)) {
+        if (placement.cells.empty())
             continue;
-        char target = board[cells[0]];
+        char target = board[placement.cells[0]];
         if (target == ORB_WEB_NAME[0])
             continue;
-        bool ok = true;
-        for (int cell : cells) {
-            if (board[cell] != target) {
-                ok = false;
-                break;
-            }
-        }
-        if (ok) {
+        if ((letter_mask[(unsigned char)target] & placement.mask) == placement.mask) {
             if (color)
                 *color = target;
             return true;
@@ -659,61 +1716,72 @@ shape_result solve_shape(const std::string& board,
                          const std::array<bool, MAX_BOARD_LENGTH>& blocked) {
     shape_result result;
     result.final_board = board;
-    if ((int)board.size() != rows * cols || board.size() > MAX_BOARD_LENGTH) {
-        result.note = "invalid board size";
+    game_board orbs;
+    if (!valid_board(board, rows, cols, orbs, result.note))
         return result;
-    }
 
-    std::vector<Candidate> candidates;
-    if (request.mode == color_prefer && has_color_filter(request)) {
-        candidates = ranked_candidates(board, rows, cols, request, blocked, true);
-        if (candidates.empty())
-            candidates = ranked_candidates(board, rows, cols, request, blocked, false);
-    } else {
-        candidates = ranked_candidates(board, rows, cols, request, blocked, false);
-    }
+    shape_found found = solve_orbs(orbs, rows, cols, request, blocked);
+    to_result(found, rows * cols, result);
+    return result;
+}
 
-    if (candidates.empty()) {
-        result.note = "no feasible candidate";
+shape_result solve_shape(const std::string& board,
+                         int rows,
+                         int cols,
+                         const shape_request& request,
+                         const std::array<bool, MAX_BOARD_LENGTH>& blocked,
+                         solution_cache* cache) {
+    shape_result result;
+    result.final_board = board;
+    game_board orbs;
+    if (!valid_board(board, rows, cols, orbs, result.note))
+        return result;
+    if (cache == nullptr) {
+        to_result(solve_orbs(orbs, rows, cols, request, blocked), rows * cols, result);
         return result;
     }
 
-    shape_result best;
-    best.final_board = board;
-    std::string last_note = "no candidate tried";
-    int limit = (int)candidates.size();
-    for (int i = 0; i < limit; ++i) {
-        std::string attempt = board;
-        std::string route;
-        int start = -1;
-        if (!run_constructive_for_candidate(attempt, rows, cols, candidates[i], blocked,
-                                            request.allow_diagonal, start, route, last_note)) {
-            continue;
-        }
-        auto combo = evaluate_combo(attempt);
-        shape_result current;
-        current.success = true;
-        current.steps = (int)route.size();
-        current.start = start;
-        current.color = candidates[i].color;
-        current.combo = combo.first;
-        current.max_combo = combo.second;
-        current.route = route;
-        current.final_board = attempt;
-        current.note = candidate_note(candidates[i]);
-
-        if (!best.success || current.combo > best.combo ||
-            (current.combo == best.combo && current.steps < best.steps)) {
-            best = current;
-        }
+    // colours only matter if the request picks some
+    bool fixed[ORB_COUNT]{false};
+    if (request.mode != color_auto) {
+        for (int i = 0; i < ORB_COUNT; ++i)
+            fixed[i] = request.colors[i];
     }
+    canonical_board canonical(orbs, rows, cols, blocked, fixed);
+    auto settings = shape_settings(request, rows, cols);
 
-    if (best.success) {
-        best.note += " combo-optimized";
-        return best;
+    cached_solution solution;
+    if (cache->find(canonical, settings, solution)) {
+        result.note = "cached";
+        if (!solution.success)
+            return result;
+        result.success = true;
+        result.steps = (int)solution.directions.size();
+        result.start = canonical.position(solution.begin);
+        result.color = canonical.to_caller((orb)solution.colour);
+        result.combo = solution.combo;
+        result.max_combo = solution.max_combo;
+        for (int direction : solution.directions)
+            result.route += MOVE_NAME[canonical.direction(direction)];
+        auto final_board = canonical.to_caller(solution.final_board);
+        for (int i = 0; i < rows * cols; ++i)
+            result.final_board[i] = ORB_WEB_NAME[final_board[i]];
+        return result;
     }
 
-    result.note = last_note;
+    auto found = solve_orbs(orbs, rows, cols, request, blocked);
+    solution.success = found.result.success;
+    if (solution.success) {
+        solution.begin = canonical.position(found.result.start);
+        solution.colour = canonical.to_canonical((orb)found.result.color);
+        solution.combo = found.result.combo;
+        solution.max_combo = found.result.max_combo;
+        solution.final_board = canonical.to_canonical(found.final_board);
+        for (tiny direction : found.route)
+            solution.directions.push_back(canonical.direction(direction));
+    }
+    cache->store(canonical, settings, solution);
+    to_result(found, rows * cols, result);
     return result;
 }
 
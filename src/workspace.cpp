@@ -0,0 +1,73 @@
+// workspace.cpp
+// Starting threads and allocating the beam for every depth and every search
+// costs more than searching a small beam, a workspace keeps them around.
+
+#include <pazusoba/core.h>
+
+namespace pazusoba {
+
+worker_pool::~worker_pool() {
+    {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        STOP = true;
+    }
+    WAKE.notify_all();
+    for (auto& t : THREADS)
+        t.join();
+}
+
+void worker_pool::work(const int thread_num) {
+    int seen = 0;
+    while (true) {
+        std::function<void(int)> task;
+        {
+            std::unique_lock<std::mutex> lock(MUTEX);
+            WAKE.wait(lock, [&] { return STOP || GENERATION != seen; });
+            if (STOP)
+                return;
+            seen = GENERATION;
+            // fewer tasks than threads this time
+            if (thread_num >= TASK_COUNT)
+                continue;
+            task = TASK;
+        }
+
+        task(thread_num);
+        {
+            std::lock_guard<std::mutex> lock(MUTEX);
+            RUNNING--;
+        }
+        DONE.notify_one();
+    }
+}
+
+void worker_pool::run(const int count, const std::function<void(int)>& task) {
+    if (count <= 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        // threads are only started when they are needed
+        while ((int)THREADS.size() < count - 1) {
+            int thread_num = THREADS.size() + 1;
+            THREADS.emplace_back([this, thread_num] { work(thread_num); });
+        }
+        TASK = task;
+        TASK_COUNT = count;
+        RUNNING = count - 1;
+        GENERATION++;
+    }
+    WAKE.notify_all();
+
+    task(0);
+    std::unique_lock<std::mutex> lock(MUTEX);
+    DONE.wait(lock, [this] { return RUNNING == 0; });
+}
+
+int default_thread_count() {
+    int processor_count = std::thread::hardware_concurrency();
+    if (processor_count <= 0)
+        processor_count = 1;
+    return processor_count;
+}
+
+}  // namespace pazusoba
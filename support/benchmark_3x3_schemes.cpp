@@ -1,3 +1,4 @@
+#include <pazusoba/shape.h>
 #include <algorithm>
 #include <array>
 #include <chrono>
@@ -757,6 +758,26 @@ SearchResult scheme_b_astar(const std::string& input) {
     return astar_search(input, 10000, 4.0);
 }
 
+// the weighted A* of the library, the same search with packed states
+SearchResult scheme_f_library_astar(const std::string& input) {
+    auto started = std::chrono::high_resolution_clock::now();
+    pazusoba::shape_request request;
+    request.search = pazusoba::shape_astar;
+    request.threads = 1;
+    auto shape = pazusoba::solve_shape(input, ROWS, COLS, request);
+    SearchResult result;
+    result.success = shape.success;
+    result.steps = shape.steps;
+    result.start = shape.start;
+    result.route = shape.route;
+    result.final_board = shape.final_board;
+    result.note = shape.note;
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() -
+                                                          started)
+                    .count();
+    return result;
+}
+
 SearchResult scheme_c_beam_with_limit(const std::string& input, int time_limit_ms) {
     auto started = std::chrono::high_resolution_clock::now();
     Candidate target = best_candidate(input);
@@ -777,9 +798,9 @@ SearchResult scheme_c_beam_with_limit(const std::string& input, int time_limit_m
     }
     std::unordered_set<std::string> seen;
 
-    constexpr int MAX_DEPTH = 60;
+    constexpr int BEAM_DEPTH = 60;
     constexpr int BEAM_WIDTH = 200;
-    for (int depth = 0; depth < MAX_DEPTH; ++depth) {
+    for (int depth = 0; depth < BEAM_DEPTH; ++depth) {
         if (time_elapsed_ms(started) >= static_cast<uint64_t>(time_limit_ms)) break;
         std::vector<PathState> next_beam;
         next_beam.reserve(BEAM_WIDTH * 4);
@@ -979,6 +1000,34 @@ bool validate_success(const std::string& input, const std::string& name, const S
     return true;
 }
 
+// the library searches on every shape with the corners blocked, A* and IDA*
+// plan whole orbs at once so their routes should be no longer
+void compare_library_searches() {
+    const std::string board = "RBGRBGGRBRGBBGRRBGGBRBRGRBBGRG";
+    std::array<bool, MAX_BOARD_LENGTH> blocked{};
+    blocked[0] = blocked[SIZE - 1] = true;
+    int longer = 0;
+    std::cout << "\n=== Library searches, corners blocked ===\n";
+    for (int kind = pazusoba::shape_3x3_square; kind <= pazusoba::shape_full_column; ++kind) {
+        for (int diagonal = 0; diagonal < 2; ++diagonal) {
+            pazusoba::shape_request request;
+            request.shape = kind;
+            request.allow_diagonal = diagonal;
+            request.threads = 1;
+            auto constructive = pazusoba::solve_shape(board, ROWS, COLS, request, blocked);
+            request.search = pazusoba::shape_astar;
+            auto astar = pazusoba::solve_shape(board, ROWS, COLS, request, blocked);
+            request.search = pazusoba::shape_ida;
+            auto ida = pazusoba::solve_shape(board, ROWS, COLS, request, blocked);
+            if (astar.success && constructive.success && astar.steps > constructive.steps) ++longer;
+            std::cout << "shape=" << kind << " diagonal=" << diagonal
+                      << ": constructive=" << constructive.steps << ", A*=" << astar.steps
+                      << ", IDA*=" << ida.steps << "\n";
+        }
+    }
+    std::cout << "A* longer than constructive: " << longer << "\n";
+}
+
 bool run_stress_test(int cases) {
     constexpr int SEARCH_LIMIT_MS = 2000;
     std::mt19937 rng(20260707);
@@ -1071,7 +1120,7 @@ int main(int argc, char* argv[]) {
             compare_all = true;
         } else if (arg == "--help" || arg == "-h") {
             std::cout << "Usage: benchmark_3x3_schemes.exe [--compare] [--stress N] [--stress-only]\n";
-            std::cout << "Default demo route: B weighted A*. Use --compare to run A-E.\n";
+            std::cout << "Default demo route: B weighted A*. Use --compare to run A-F.\n";
             return 0;
         } else {
             std::cerr << "Unknown argument: " << arg << "\n";
@@ -1108,6 +1157,7 @@ int main(int argc, char* argv[]) {
                 {"C beam", scheme_c_beam},
                 {"D GRASP", scheme_d_grasp},
                 {"E pipeline", scheme_e_pipeline},
+                {"F library A*", scheme_f_library_astar},
             };
         }
 
@@ -1121,6 +1171,7 @@ int main(int argc, char* argv[]) {
                       << ", note=" << result.note << "\n";
         }
     }
+    if (compare_all) compare_library_searches();
     }
 
     if (stress_cases > 0 && !run_stress_test(stress_cases)) {
@@ -0,0 +1,139 @@
+// benchmark_shorten.cpp
+// Average steps removed by shorten_route() from adventure() and
+// solve_shape() routes on the sample boards in assets/.
+
+#include <pazusoba/core.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct summary {
+    int routes = 0;
+    int steps = 0;
+    int saved = 0;
+    double ms = 0;
+
+    void add(int original, int removed, double time) {
+        routes++;
+        steps += original;
+        saved += removed;
+        ms += time;
+    }
+
+    void print(const std::string& name) const {
+        if (routes == 0)
+            return;
+        std::cout << name << ": " << routes << " routes, " << steps << " steps, "
+                  << saved << " saved, " << (double)saved / routes
+                  << " saved on average, " << ms / routes << " ms on average\n";
+    }
+};
+
+int board_rows(const std::string& board) {
+    if (board.size() == 20)
+        return 4;
+    if (board.size() == 30)
+        return 5;
+    return 6;
+}
+
+pazusoba::shortened_route timed_shorten(const std::string& board,
+                                        int start,
+                                        const std::string& route,
+                                        const pazusoba::route_options& options,
+                                        double& ms) {
+    int rows = board_rows(board);
+    int cols = board.size() / rows;
+    auto begin = std::chrono::steady_clock::now();
+    auto result = pazusoba::shorten_route(board, rows, cols, start, route, options);
+    auto end = std::chrono::steady_clock::now();
+    ms = std::chrono::duration<double, std::milli>(end - begin).count();
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const std::vector<std::pair<std::string, std::string>> boards = {
+        {"sample_board_4erase.txt", "HHHBBBHHHGHBRGGGGBRHHGHHRRRHHH"},
+        {"sample_board_65.txt", "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL"},
+        {"sample_board_65_2.txt", "BRBRRRRRRBRBRRBRRRBRRRBRRRBRRR"},
+        {"sample_board_65_4_fire.txt", "RRRRRRRBRBRRRRBRGRRRRRGRRRRLRR"},
+        {"sample_board_65_erase.txt", "RRRBBBGGLLLLRBGHHHRBDLLHRBGDDL"},
+        {"sample_board_65_score.txt", "RRRBBBRBLLLLRBGHHHRBLLLHGGGDDD"},
+        {"sample_board_76.txt", "BGGRRLRBBDBGLLHBDRLRRDDLLDRRHHRLBHHDBBHRLH"},
+        {"sample_board_76_erase.txt", "RGHHBDDRLRHRBBBLRDDBBBLRLLBBBGRGGLLRGBBBGG"},
+        {"sample_board_floodfill_bug.txt", "GGHHHHGRGHHRGHRRRRGHRGGHRHRRRR"},
+    };
+
+    pazusoba::route_options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--window=") == 0) {
+            options.window = std::atoi(arg.c_str() + 9);
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: benchmark_shorten [--window=N]\n";
+            return 0;
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    summary beam_exact;
+    summary beam_combo;
+    summary shapes;
+    for (const auto& sample : boards) {
+        const std::string& board = sample.second;
+        int rows = board_rows(board);
+        int cols = board.size() / rows;
+
+        pazusoba::solver solver;
+        solver.set_board(board.c_str());
+        solver.set_search_depth(50);
+        solver.set_beam_size(1000);
+        pazusoba::profile profile;
+        profile.name = pazusoba::target_combo;
+        solver.set_profiles(&profile, 1);
+        auto state = solver.adventure();
+        if (state.step > 1) {
+            std::string route = solver.get_route_string(state);
+            double ms = 0;
+            options.same_combo = false;
+            auto exact = timed_shorten(board, state.begin, route, options, ms);
+            beam_exact.add(state.step, exact.saved, ms);
+            options.same_combo = true;
+            auto combo = timed_shorten(board, state.begin, route, options, ms);
+            beam_combo.add(state.step, combo.saved, ms);
+            std::cout << sample.first << " beam " << (int)state.step << " steps, "
+                      << exact.saved << " saved, " << combo.saved
+                      << " saved with the same combos\n";
+        }
+
+        options.same_combo = false;
+        for (int kind = pazusoba::shape_3x3_square; kind <= pazusoba::shape_full_column; kind++) {
+            pazusoba::shape_request request;
+            request.shape = kind;
+            auto result = pazusoba::solve_shape(board, rows, cols, request);
+            if (!result.success || result.steps <= 1)
+                continue;
+            double ms = 0;
+            auto shortened = timed_shorten(board, result.start, result.route, options, ms);
+            shapes.add(result.steps, shortened.saved, ms);
+            std::cout << sample.first << " shape " << kind << " " << result.steps
+                      << " steps, " << shortened.saved << " saved\n";
+        }
+    }
+
+    std::cout << "\n=== window " << options.window << " ===\n";
+    beam_exact.print("beam, same board");
+    beam_combo.print("beam, same combos");
+    shapes.print("shape, same board");
+    return 0;
+}
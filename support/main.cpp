@@ -1,6 +1,55 @@
 #include <pazusoba/core.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
 int main(int argc, char* argv[]) {
+    // pazusoba --daemon[=socket] [--workers=N] [--threads=N] [--metrics=port]
+    //           [--cache=file] [--cache-size=N]
+    if (argc > 1 && strncmp(argv[1], "--daemon", 8) == 0) {
+        pazusoba::daemon_options options;
+        if (argv[1][8] == '=')
+            options.socket_path = argv[1] + 9;
+        for (int i = 2; i < argc; i++) {
+            if (strncmp(argv[i], "--workers=", 10) == 0)
+                options.workers = atoi(argv[i] + 10);
+            else if (strncmp(argv[i], "--threads=", 10) == 0)
+                options.threads = atoi(argv[i] + 10);
+            else if (strncmp(argv[i], "--metrics=", 10) == 0)
+                options.metrics = argv[i] + 10;
+            else if (strncmp(argv[i], "--cache=", 8) == 0)
+                options.cache = argv[i] + 8;
+            else if (strncmp(argv[i], "--cache-size=", 13) == 0)
+                options.cache_size = atoi(argv[i] + 13);
+        }
+        return pazusoba::run_daemon(options);
+    }
+
+    // pazusoba --bulk[=file] [--jobs=N] [--threads=N] [--cache=file]
+    //           [--cache-size=N] [key=value]...
+    if (argc > 1 && strncmp(argv[1], "--bulk", 6) == 0) {
+        pazusoba::bulk_options options;
+        if (argv[1][6] == '=')
+            options.path = argv[1] + 7;
+        for (int i = 2; i < argc; i++) {
+            if (strncmp(argv[i], "--jobs=", 7) == 0)
+                options.jobs = atoi(argv[i] + 7);
+            else if (strncmp(argv[i], "--threads=", 10) == 0)
+                options.threads = atoi(argv[i] + 10);
+            else if (strncmp(argv[i], "--cache=", 8) == 0)
+                options.cache = argv[i] + 8;
+            else if (strncmp(argv[i], "--cache-size=", 13) == 0)
+                options.cache_size = atoi(argv[i] + 13);
+            else
+                options.defaults += std::string(argv[i]) + " ";
+        }
+        return pazusoba::run_bulk(options);
+    }
+
+    // pazusoba --pack=corpus [file]
+    if (argc > 1 && strncmp(argv[1], "--pack=", 7) == 0)
+        return pazusoba::run_pack(argc > 2 ? argv[2] : "", argv[1] + 7);
+
     auto solver = pazusoba::solver();
     solver.parse_args(argc, argv);
 
@@ -11,8 +60,17 @@ int main(int argc, char* argv[]) {
     profiles[0].stop_threshold = 100;
     solver.set_profiles(profiles, 1);
 
+    // the prefix can be executed before the search finishes
+    solver.set_commit_callback([&solver](const pazusoba::state& prefix) {
+        printf("Committed ");
+        solver.print_route(prefix.route, prefix.step, prefix.begin);
+    });
+
     pazusoba::Timer timer("adventure");
     auto state = solver.adventure();
     solver.print_state(state);
+    printf("Pruned: %d\n", solver.pruned_count());
+    if (solver.shortening())
+        printf("Saved steps: %d\n", solver.saved_steps());
     return 0;
 }
\ No newline at end of file
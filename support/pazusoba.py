@@ -82,6 +82,56 @@ class State:
 orb_list = (c_bool*11)
 
 
+class c_compact_state(Structure):
+    _fields_ = [("combo", c_int),
+                ("max_combo", c_int),
+                ("step", c_int),
+                ("row", c_int),
+                ("column", c_int),
+                ("goal", c_bool),
+                ("start", c_int),
+                ("directions", c_ubyte*150),
+                ("segment_count", c_int),
+                ("segment_directions", c_ubyte*150),
+                ("segment_lengths", c_ubyte*150),
+                ("board", c_ubyte*42),
+                ("colour_combo", c_ubyte*11),
+                ("rejected", c_bool)]
+
+
+# bytes from the library are translated to letters in one go
+DIRECTION_TABLE = bytes.maketrans(bytes(range(8)), b"UDLRQEZC")
+ORB_TABLE = bytes.maketrans(bytes(range(11)), b" RBGLDHJEPT")
+
+
+class CompactState:
+    def __init__(self, raw):
+        self.combo = raw.combo
+        self.max_combo = raw.max_combo
+        self.step = raw.step
+        self.row = raw.row
+        self.column = raw.column
+        self.goal = raw.goal
+        # a batch job with a bad board, step is -1 and nothing else is set
+        self.rejected = raw.rejected
+        # row and column of the first orb, -1 if there is no route
+        self.start = divmod(raw.start, raw.column) if raw.step > 0 else (-1, -1)
+        self.route = bytes(raw.directions)[:max(raw.step, 0)].translate(
+            DIRECTION_TABLE).decode("ascii")
+        directions = bytes(raw.segment_directions)[:raw.segment_count].translate(
+            DIRECTION_TABLE).decode("ascii")
+        self.segments = list(
+            zip(directions, bytes(raw.segment_lengths)[:raw.segment_count]))
+        self.simplified_step = raw.segment_count + 1
+        self.board = bytes(raw.board)[:raw.row * raw.column].translate(
+            ORB_TABLE).decode("ascii")
+        self.colour_combo = bytes(raw.colour_combo)
+
+    def __repr__(self):
+        return "Combo: {}/{}\nStep: {} ({})\nSize: {} x {}\nGoal: {}\nStart: {}\nRoute: {}\nBoard: {}".format(
+            self.combo, self.max_combo, self.step, self.simplified_step, self.row, self.column, self.goal, self.start, self.route, self.board)
+
+
 class Orb(enum.Enum):
     EMPTY = 0
     FIRE = 1
@@ -100,6 +150,7 @@ class c_profile(Structure):
     _fields_ = [("name", c_int),
                 ("stop_threshold", c_int),
                 ("target", c_int),
+                ("colour_target", c_int),
                 ("orbs", orb_list)]
 
 
@@ -117,7 +168,7 @@ class ProfileName(enum.Enum):
 
 
 class Profile:
-    def __init__(self, name: ProfileName, threshold: int = 20, target: int = -1, orbs: List[bool] = None):
+    def __init__(self, name: ProfileName, threshold: int = 20, target: int = -1, orbs: List[bool] = None, colour_target: int = 0):
         if orbs is None:
             # default to 5 colours + heal
             c_orb_list = orb_list(
@@ -126,7 +177,26 @@ class Profile:
             c_orb_list = orb_list(*orbs)
 
         self.c_profile = c_profile(
-            int(name.value), threshold, target, c_orb_list)
+            int(name.value), threshold, target, colour_target, c_orb_list)
+
+
+class c_verdict(Structure):
+    _fields_ = [("feasible", c_bool),
+                ("relaxed", c_bool),
+                ("target", c_int),
+                ("colour_target", c_int)]
+
+
+class Verdict:
+    def __init__(self, raw):
+        self.feasible = raw.feasible
+        self.relaxed = raw.relaxed
+        self.target = raw.target
+        self.colour_target = raw.colour_target
+
+    def __repr__(self):
+        return "Feasible: {}, Relaxed: {}, Target: {}".format(
+            self.feasible, self.relaxed, self.target)
 
 
 def convert(orbs: List[Orb]) -> List[bool]:
@@ -151,6 +221,97 @@ def adventureEx(board: str, min_erase: int, search_depth: int, beam_size: int, p
     return State(state)
 
 
+class Solver:
+    """Keep one solver in the library and reuse it for every board, buffers and threads stay warm between turns"""
+
+    def __init__(self, min_erase: int, search_depth: int, beam_size: int, profiles: List[Profile]):
+        self.handle = libpazusoba.solverCreate()
+        # the library writes every result into the same buffer
+        self.result = c_state()
+        self.compact = c_compact_state()
+        self.configure(min_erase, search_depth, beam_size, profiles)
+
+    def configure(self, min_erase: int, search_depth: int, beam_size: int, profiles: List[Profile]):
+        profile_count = len(profiles)
+        c_profile_list = (c_profile * profile_count)()
+        for i in range(profile_count):
+            c_profile_list[i] = profiles[i].c_profile
+        libpazusoba.solverConfigure(
+            self.handle, min_erase, search_depth, beam_size, c_profile_list, profile_count)
+
+    def solve(self, board: str) -> State:
+        """Raise ValueError if the library rejects the board"""
+        c_board = c_char_p(board.encode("ascii"))
+        if not libpazusoba.solverSolve(self.handle, c_board, byref(self.result)):
+            raise ValueError(libpazusoba.solverError(self.handle).decode("ascii"))
+        return State(self.result)
+
+    def solve_compact(self, board: str, segments: bool = True, colour_combo: bool = True) -> CompactState:
+        """Same as solve() but the route comes back as one byte per step"""
+        c_board = c_char_p(board.encode("ascii"))
+        if not libpazusoba.solverSolveCompact(
+                self.handle, c_board, segments, colour_combo, byref(self.compact)):
+            raise ValueError(libpazusoba.solverError(self.handle).decode("ascii"))
+        return CompactState(self.compact)
+
+    def close(self):
+        if self.handle:
+            libpazusoba.solverFree(self.handle)
+            self.handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+
+class c_job(Structure):
+    _fields_ = [("board", c_char_p),
+                ("min_erase", c_int),
+                ("search_depth", c_int),
+                ("beam_size", c_int),
+                ("profiles", POINTER(c_profile)),
+                ("count", c_int)]
+
+
+def adventureBatch(boards: List[str], min_erase: int, search_depth: int, beam_size: int, profiles: List[Profile], threads: int = 0) -> List[CompactState]:
+    """Solve every board with the same settings over one set of threads, boards
+    the library rejects come back with rejected set and step -1"""
+    profile_count = len(profiles)
+    c_profile_list = (c_profile * profile_count)()
+    for i in range(profile_count):
+        c_profile_list[i] = profiles[i].c_profile
+    c_boards = [b.encode("ascii") for b in boards]
+    c_jobs = (c_job * len(boards))()
+    for i, b in enumerate(c_boards):
+        c_jobs[i] = c_job(b, min_erase, search_depth,
+                          beam_size, c_profile_list, profile_count)
+    c_results = (c_compact_state * len(boards))()
+
+    libpazusoba.adventureBatch(c_jobs, len(boards), threads, c_results, None)
+    return [CompactState(r) for r in c_results]
+
+
+def feasibilityEx(board: str, min_erase: int, profiles: List[Profile]) -> List[Verdict]:
+    """Check if the board can fulfill every profile without searching, raise
+    ValueError if the library rejects the board"""
+    c_board = c_char_p(board.encode("ascii"))
+    profile_count = len(profiles)
+    c_profile_list = (c_profile * profile_count)()
+    for i in range(profile_count):
+        c_profile_list[i] = profiles[i].c_profile
+    c_verdict_list = (c_verdict * profile_count)()
+
+    if libpazusoba.feasibilityEx(
+            c_board, min_erase, c_profile_list, profile_count, c_verdict_list) < 0:
+        raise ValueError("invalid board " + board)
+    return [Verdict(v) for v in c_verdict_list]
+
+
 def adventure(arguments: List[str]) -> State:
     # additional step is required here because Mac is stricter than Windows
     argv = []
@@ -164,7 +325,10 @@ def adventure(arguments: List[str]) -> State:
     return State(state)
 
 
-if (os.path.exists("libpazusoba.dll")):
+if "PAZUSOBA_LIBRARY" in os.environ:
+    # a library built by cmake, e.g. build/libpazusoba.so
+    so_path = [os.environ["PAZUSOBA_LIBRARY"]]
+elif (os.path.exists("libpazusoba.dll")):
     so_path = ["libpazusoba.dll"]
 else:
     so_path = glob.glob("build/lib*/pazusoba*")
@@ -181,6 +345,29 @@ libpazusoba.adventureEx.restype = c_state
 libpazusoba.adventureEx.argtypes = (
     POINTER(c_char), c_int, c_int, c_int, POINTER(c_profile), c_int)
 
+libpazusoba.solverCreate.restype = c_void_p
+libpazusoba.solverCreate.argtypes = ()
+libpazusoba.solverConfigure.restype = None
+libpazusoba.solverConfigure.argtypes = (
+    c_void_p, c_int, c_int, c_int, POINTER(c_profile), c_int)
+libpazusoba.solverSolve.restype = c_bool
+libpazusoba.solverSolve.argtypes = (c_void_p, POINTER(c_char), POINTER(c_state))
+libpazusoba.solverSolveCompact.restype = c_bool
+libpazusoba.solverSolveCompact.argtypes = (
+    c_void_p, POINTER(c_char), c_bool, c_bool, POINTER(c_compact_state))
+libpazusoba.solverError.restype = c_char_p
+libpazusoba.solverError.argtypes = (c_void_p,)
+libpazusoba.solverFree.restype = None
+libpazusoba.solverFree.argtypes = (c_void_p,)
+
+libpazusoba.adventureBatch.restype = None
+libpazusoba.adventureBatch.argtypes = (
+    POINTER(c_job), c_int, c_int, POINTER(c_compact_state), c_void_p)
+
+libpazusoba.feasibilityEx.restype = c_int
+libpazusoba.feasibilityEx.argtypes = (
+    POINTER(c_char), c_int, POINTER(c_profile), c_int, POINTER(c_verdict))
+
 if __name__ == "__main__":
     # state = adventure(
     #     ["pazusoba", "RLRRDBHBLDBLDHRGLGBRGLBDBHDGRL", "3", "100", "10000"])
@@ -97,19 +97,16 @@ std::string board_from_state(const pazusoba::solver& solver, const pazusoba::gam
     return solver.get_board_string(board);
 }
 
-bool has_exact_connected_target(const std::string& board) {
-    pazusoba::solver solver;
-    solver.set_board(board.c_str());
+bool has_exact_connected_target(const pazusoba::game_board& board, int rows, int cols) {
     pazusoba::profile profile;
     profile.name = pazusoba::connected_orb;
     profile.target = 4;
     profile.orbs[1] = true;
     profile.orbs[3] = true;
-    solver.set_profiles(&profile, 1);
-    auto copy = solver.board();
-    pazusoba::state state;
-    solver.evaluate(copy, state);
-    return state.goal;
+    pazusoba::evaluation_plan plan;
+    plan.profiles = &profile;
+    plan.count = 1;
+    return pazusoba::evaluate_board(board, rows, cols, 3, &plan).goal;
 }
 
 bool replay_route(const std::string& input,
@@ -243,7 +240,7 @@ TimedResult run_priority_4_mode(const std::string& board, bool allow_diagonal) {
     out.ms = std::chrono::duration<double, std::milli>(end - start).count();
     std::string final_board = board_from_state(solver, state.board);
     out.ok = replay_solver_route(board, 5, 6, state, final_board) &&
-             has_exact_connected_target(final_board);
+             has_exact_connected_target(state.board, 5, 6);
     out.steps = state.step;
     out.start = state.begin;
     out.combo = state.combo;
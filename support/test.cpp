@@ -1,5 +1,11 @@
+// every test is an assert, keep them in release builds too
+#undef NDEBUG
+#include <pazusoba/api.h>
 #include <pazusoba/core.h>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <thread>
 
 
 void print_combo(const pazusoba::combo_list& combos) {
@@ -52,6 +58,60 @@ int main() {
     printf("test set_board passed\n");
     printf("====================================\n");
 
+    ///
+    /// Max combo
+    ///
+
+    printf("test max combo\n");
+    // min erase changes the max combo
+    solver.set_min_erase(4);
+    assert(solver.max_combo() == 5);
+    solver.set_min_erase(5);
+    assert(solver.max_combo() == 4);
+    solver.set_min_erase(3);
+    assert(solver.max_combo() == 8);
+
+    // one colour is always one combo
+    auto max_combo_solver = pazusoba::solver();
+    max_combo_solver.set_board("RRRRRRRRRRRRRRRRRRRRRRRRRRRRRR");
+    assert(max_combo_solver.max_combo() == 1);
+    // 3 blue orbs can't split red
+    max_combo_solver.set_board("RRRRRRRRRRRRRRRRRRRRRRRRRRRBBB");
+    assert(max_combo_solver.max_combo() == 2);
+    // 7x6 with empty orbs, assets/sample_board_76_empty.txt
+    max_combo_solver.set_board("BGGRRLR DDB LL BD   R D   RRRHRLBHH   HRLH");
+    assert(max_combo_solver.max_combo() == 7);
+    // the packing search gives up on 12 red orbs, that is no proof that 5
+    // combos can't be made so the counting bound is kept
+    pazusoba::orb_list crowded{0, 12, 3, 2, 1, 1, 1};
+    assert(pazusoba::pack_max_combo(crowded, 4, 5, 3) == 5);
+    assert(pazusoba::estimate_max_combo(crowded, 4, 5, 3) == 5);
+
+    // max combo goal stops the search as soon as it is reached
+    max_combo_solver.set_board("RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL");
+    max_combo_solver.set_search_depth(50);
+    max_combo_solver.set_beam_size(1000);
+    pazusoba::profile max_combo_profile;
+    max_combo_profile.name = pazusoba::target_combo;
+    max_combo_solver.set_profiles(&max_combo_profile, 1);
+    auto max_combo_state = max_combo_solver.adventure();
+    assert(max_combo_state.goal);
+    assert(max_combo_state.combo == max_combo_solver.max_combo());
+
+    // 2 is short of the counting bound so it is only a reference, reaching
+    // it is not a goal
+    max_combo_solver.set_board("RRRRRRRRRRRRRRRRRRRRRRRRRRRBBB");
+    pazusoba::orb_list reference{0, 27, 3};
+    assert(pazusoba::count_max_combo(reference, 3) == 10);
+    max_combo_solver.set_search_depth(10);
+    max_combo_solver.set_beam_size(100);
+    auto reference_state = max_combo_solver.adventure();
+    assert(!reference_state.goal);
+    assert(reference_state.combo <= max_combo_solver.max_combo());
+
+    printf("test max combo passed\n");
+    printf("====================================\n");
+
     ///
     /// Expand
     ///
@@ -518,6 +578,1005 @@ int main() {
     printf("test erase combo passed\n");
     printf("====================================\n");
 
+    ///
+    /// Pruning
+    ///
+
+    printf("test pruning\n");
+    // boards from assets/, pruning must not change the result
+    const char* pruning_boards[] = {
+        "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL",  // sample_board_65.txt
+        "GGHHHHGRGHHRGHRRRRGHRGGHRHRRRR",  // sample_board_floodfill_bug.txt
+        "RGHHBDDRLRHRBBBLRDDBBBLRLLBBBGRGGLLRGBBBGG",  // sample_board_76_erase.txt
+    };
+    int total_pruned = 0;
+    for (const auto& board : pruning_boards) {
+        pazusoba::state results[2];
+        for (int i = 0; i < 2; i++) {
+            auto pruning_solver = pazusoba::solver();
+            pruning_solver.set_board(board);
+            pruning_solver.set_search_depth(30);
+            pruning_solver.set_beam_size(1000);
+            pruning_solver.set_pruning(i == 1);
+            pazusoba::profile combo_profile;
+            combo_profile.name = pazusoba::target_combo;
+            combo_profile.stop_threshold = 30;
+            pruning_solver.set_profiles(&combo_profile, 1);
+            results[i] = pruning_solver.adventure();
+            if (i == 1)
+                total_pruned += pruning_solver.pruned_count();
+            else
+                assert(pruning_solver.pruned_count() == 0);
+        }
+        printf("%s combo %d, pruned run combo %d\n", board, results[0].combo,
+               results[1].combo);
+        assert(results[0].combo == results[1].combo);
+        assert(results[0].score == results[1].score);
+        assert(results[0].step == results[1].step);
+        assert(results[0].route == results[1].route);
+    }
+    printf("pruned %d states\n", total_pruned);
+    assert(total_pruned > 0);
+
+    // red orbs can't form a line if nothing can be moved
+    solver.set_board("RBGRBGLDHLDHRBGRBGLDHLDHHGLHGL");
+    int colour_combo[ORB_COUNT]{0};
+    int stuck = solver.combo_upper_bound(solver.board(), 29, 0, colour_combo);
+    assert(colour_combo[1] == 0);
+    int reachable = solver.combo_upper_bound(solver.board(), 29, 20, colour_combo);
+    assert(colour_combo[1] == 1);
+    printf("combo bound %d with no step, %d with 20 steps\n", stuck, reachable);
+    assert(stuck < reachable);
+
+    printf("test pruning passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Tail refinement
+    ///
+
+    printf("test tail refinement\n");
+    // boards from assets/, a small beam leaves something to refine
+    const char* refine_boards[] = {
+        "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL",  // sample_board_65.txt
+        "BGGRRLRBBDBGLLHBDRLRRDDLLDRRHHRLBHHDBBHRLH",  // sample_board_76.txt
+    };
+    int improved = 0;
+    for (const auto& board : refine_boards) {
+        pazusoba::state results[2];
+        pazusoba::game_board replayed;
+        for (int i = 0; i < 2; i++) {
+            auto refine_solver = pazusoba::solver();
+            refine_solver.set_board(board);
+            refine_solver.set_search_depth(15);
+            refine_solver.set_beam_size(100);
+            if (i == 1)
+                refine_solver.set_refine(8, 8, 10000);
+            pazusoba::profile combo_profile;
+            combo_profile.name = pazusoba::target_combo;
+            combo_profile.stop_threshold = 100;
+            refine_solver.set_profiles(&combo_profile, 1);
+            results[i] = refine_solver.adventure();
+            replayed = refine_solver.board();
+        }
+
+        // the refined route must lead to the refined board
+        const auto& refined = results[1];
+        int column = strlen(board) == 42 ? 7 : 6;
+        int adjustments[] = {-column, column, -1, 1,
+                             -column - 1, -column + 1, column - 1, column + 1};
+        int curr = refined.begin;
+        for (int s = 0; s < refined.step; s++) {
+            int index = s / ROUTE_PER_LIST;
+            int count = std::min(refined.step - index * ROUTE_PER_LIST, ROUTE_PER_LIST);
+            int shift = (count - 1 - s % ROUTE_PER_LIST) * 3;
+            int next = curr + adjustments[(refined.route[index] >> shift) & 7];
+            std::swap(replayed[curr], replayed[next]);
+            curr = next;
+        }
+        printf("%s score %d, refined score %d\n", board, results[0].score,
+               refined.score);
+        assert(curr == refined.curr);
+        assert(replayed == refined.board);
+        assert(refined.score >= results[0].score);
+        if (refined.score > results[0].score)
+            improved++;
+    }
+    printf("refined %d boards\n", improved);
+    assert(improved > 0);
+
+    printf("test tail refinement passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Route shortening
+    ///
+
+    printf("test route shortening\n");
+    // the route from sample_board_65.txt has a detour
+    std::string route_board = "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL";
+    std::string long_route = "LLDDLULDLDRDRURDLURULLDDLURUR";
+    pazusoba::route_options route_options;
+    auto shortened = pazusoba::shorten_route(route_board, 5, 6, 5, long_route, route_options);
+    auto original = pazusoba::shorten_route(route_board, 5, 6, 5, long_route,
+                                            pazusoba::route_options{false, 0, false, 3});
+    printf("%d steps, %d saved\n", shortened.steps, shortened.saved);
+    assert(original.saved == 0);
+    assert(shortened.saved > 0);
+    assert(shortened.steps + shortened.saved == (int)long_route.size());
+    assert(shortened.final_board == original.final_board);
+
+    // going back and forth changes nothing
+    auto loop = pazusoba::shorten_route(route_board, 5, 6, 5, "LLRRDU", route_options);
+    assert(loop.steps == 0 && loop.final_board == route_board);
+
+    // routes through blocked cells are left alone
+    std::array<bool, MAX_BOARD_LENGTH> route_blocked{};
+    route_blocked[10] = true;
+    auto invalid = pazusoba::shorten_route(route_board, 5, 6, 4, "DU", route_options,
+                                           route_blocked);
+    assert(invalid.saved == 0 && invalid.route == "DU");
+    // the same combos are checked without a solver so any size works, and
+    // letters which aren't orbs leave the route alone
+    pazusoba::route_options combo_options;
+    combo_options.same_combo = true;
+    auto small = pazusoba::shorten_route("RRBGBRGGB", 3, 3, 0, "RLRDL", combo_options);
+    assert(small.saved > 0 && small.final_board.size() == 9);
+    auto unknown = pazusoba::shorten_route("RRBGBRGGX", 3, 3, 0, "RL", combo_options);
+    assert(unknown.saved == 0 && unknown.route == "RL");
+
+    auto shorten_solver = pazusoba::solver();
+    shorten_solver.set_board(route_board.c_str());
+    shorten_solver.set_search_depth(50);
+    shorten_solver.set_beam_size(1000);
+    shorten_solver.set_shorten(true);
+    pazusoba::profile shorten_profile;
+    shorten_profile.name = pazusoba::target_combo;
+    shorten_solver.set_profiles(&shorten_profile, 1);
+    auto shorten_state = shorten_solver.adventure();
+    printf("adventure saved %d steps\n", shorten_solver.saved_steps());
+    assert(shorten_state.combo == shorten_solver.max_combo());
+    assert(shorten_solver.get_route_string(shorten_state).size() == shorten_state.step);
+
+    printf("test route shortening passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Committed prefix
+    ///
+
+    printf("test committed prefix\n");
+    for (int i = 0; i < 2; i++) {
+        auto commit_solver = pazusoba::solver();
+        // sample_board_76.txt, a small beam agrees on its first moves sooner
+        commit_solver.set_board("BGGRRLRBBDBGLLHBDRLRRDDLLDRRHHRLBHHDBBHRLH");
+        commit_solver.set_search_depth(50);
+        commit_solver.set_beam_size(100);
+        if (i == 1)
+            commit_solver.set_commit(0.6);
+        pazusoba::profile commit_profile;
+        commit_profile.name = pazusoba::target_combo;
+        commit_solver.set_profiles(&commit_profile, 1);
+
+        std::vector<pazusoba::state> prefixes;
+        commit_solver.set_commit_callback(
+            [&prefixes](const pazusoba::state& prefix) { prefixes.push_back(prefix); });
+        auto commit_state = commit_solver.adventure();
+        std::string commit_route = commit_solver.get_route_string(commit_state);
+        printf("%zu prefixes, route %s\n", prefixes.size(), commit_route.c_str());
+        if (i == 0) {
+            assert(prefixes.empty());
+            continue;
+        }
+
+        // every prefix extends the previous one and the route follows them
+        assert(!prefixes.empty());
+        for (size_t j = 0; j < prefixes.size(); j++) {
+            std::string prefix = commit_solver.get_route_string(prefixes[j]);
+            assert(prefixes[j].begin == commit_state.begin);
+            assert(commit_route.compare(0, prefix.size(), prefix) == 0);
+            if (j > 0)
+                assert(prefixes[j].step > prefixes[j - 1].step);
+        }
+        assert(commit_solver.committed().step == prefixes.back().step);
+    }
+
+    printf("test committed prefix passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Async solve
+    ///
+
+    printf("test async solve\n");
+    {
+        auto async_solver = pazusoba::solver();
+        // sample_board_76.txt
+        async_solver.set_board("BGGRRLRBBDBGLLHBDRLRRDDLLDRRHHRLBHHDBBHRLH");
+        async_solver.set_search_depth(50);
+        async_solver.set_beam_size(100);
+        pazusoba::profile async_profile;
+        async_profile.name = pazusoba::target_combo;
+        async_solver.set_profiles(&async_profile, 1);
+
+        // the same search on another thread gives the same result
+        auto sync_state = async_solver.adventure();
+        pazusoba::async_solve same(async_solver);
+        const auto& same_state = same.wait();
+        auto same_progress = same.snapshot();
+        assert(same.done());
+        assert(same_progress.finished && !same_progress.cancelled);
+        assert(same_progress.best_score == sync_state.score);
+        assert(same_progress.best_combo == sync_state.combo);
+        assert(same_progress.expanded > 0);
+        assert(same_state.score == sync_state.score);
+        assert(same_state.hash == sync_state.hash);
+
+        // a large beam is cancelled after its first depth
+        async_solver.set_beam_size(100000);
+        pazusoba::async_solve cancelled(async_solver);
+        while (cancelled.snapshot().depth == 0)
+            std::this_thread::yield();
+        cancelled.cancel();
+        const auto& cancelled_state = cancelled.wait();
+        auto cancelled_progress = cancelled.snapshot();
+        printf("cancelled at depth %d, %lld states, score %d\n",
+               cancelled_progress.depth, cancelled_progress.expanded,
+               cancelled_state.score);
+        assert(cancelled_progress.cancelled && cancelled_progress.finished);
+        assert(cancelled_progress.depth < 50);
+        assert(cancelled_state.step > 0);
+        assert(cancelled_state.score == cancelled_progress.best_score);
+    }
+
+    printf("test async solve passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Reused workspace
+    ///
+
+    printf("test reused workspace\n");
+    {
+        pazusoba::worker_pool pool;
+        std::vector<int> counts(4, 0);
+        for (int round = 0; round < 3; round++) {
+            // the second round uses fewer threads than the pool has
+            int tasks = round == 1 ? 2 : 4;
+            pool.run(tasks, [&counts](int thread_num) { counts[thread_num]++; });
+        }
+        assert(pool.size() == 4);
+        assert(counts[0] == 3 && counts[1] == 3);
+        assert(counts[2] == 2 && counts[3] == 2);
+
+        // the same results as a fresh solver for every board
+        const char* workspace_boards[] = {
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL",
+            "BGGRRLRBBDBGLLHBDRLRRDDLLDRRHHRLBHHDBBHRLH",
+            "RRRBBBRBLLLLRBGHHHRBLLLHGGGDDD",
+        };
+        pazusoba::workspace space;
+        auto kept_solver = pazusoba::solver();
+        kept_solver.set_workspace(&space);
+        pazusoba::profile workspace_profile;
+        workspace_profile.name = pazusoba::target_combo;
+        for (const char* board : workspace_boards) {
+            auto fresh_solver = pazusoba::solver();
+            for (auto s : {&fresh_solver, &kept_solver}) {
+                s->set_board(board);
+                s->set_search_depth(30);
+                s->set_beam_size(500);
+                s->set_profiles(&workspace_profile, 1);
+            }
+            auto fresh_state = fresh_solver.adventure();
+            auto kept_state = kept_solver.adventure();
+            assert(fresh_state.score == kept_state.score);
+            assert(fresh_state.hash == kept_state.hash);
+            assert(!space.temp.empty());
+        }
+    }
+
+    printf("test reused workspace passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Batch solve
+    ///
+
+    printf("test batch solve\n");
+    {
+        const char* batch_boards[] = {
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL",
+            "BGGRRLRBBDBGLLHBDRLRRDDLLDRRHHRLBHHDBBHRLH",
+            "RRRBBBRBLLLLRBGHHHRBLLLHGGGDDD",
+        };
+        pazusoba::profile batch_profile;
+        batch_profile.name = pazusoba::target_combo;
+        std::vector<pazusoba::solver> batch_solvers;
+        for (int beam : {200, 2000}) {
+            for (const char* board : batch_boards) {
+                auto s = pazusoba::solver();
+                s.set_board(board);
+                s.set_search_depth(30);
+                s.set_beam_size(beam);
+                s.set_profiles(&batch_profile, 1);
+                batch_solvers.push_back(s);
+            }
+        }
+        std::vector<pazusoba::state> expected;
+        for (auto s : batch_solvers)
+            expected.push_back(s.adventure());
+
+        // beam 2000 is split over both threads, beam 200 runs one per thread
+        pazusoba::batch_options batch;
+        batch.threads = 2;
+        batch.split_threshold = 200 * 30;
+        std::vector<int> reported(batch_solvers.size(), 0);
+        batch.on_result = [&reported](int index, const pazusoba::state&) {
+            reported[index]++;
+        };
+        // the settings of the caller are put back
+        pazusoba::workspace caller_space;
+        batch_solvers[0].set_workspace(&caller_space);
+        batch_solvers[5].set_threads(3);
+        auto batch_states = pazusoba::solve_batch(batch_solvers, batch);
+        assert(batch_states.size() == batch_solvers.size());
+        assert(batch_solvers[0].current_workspace() == &caller_space);
+        assert(batch_solvers[0].threads() == 0 && batch_solvers[5].threads() == 3);
+        assert(batch_solvers[5].current_workspace() == nullptr);
+        for (size_t i = 0; i < batch_states.size(); i++) {
+            assert(reported[i] == 1);
+            assert(batch_states[i].score == expected[i].score);
+            assert(batch_states[i].combo == expected[i].combo);
+        }
+    }
+
+    printf("test batch solve passed\n");
+    printf("====================================\n");
+
+    ///
+    /// C API
+    ///
+
+    printf("test c api\n");
+    {
+        const char* api_board = "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL";
+        pazusoba::profile api_profile;
+        api_profile.name = pazusoba::target_combo;
+        void* handle = solverCreate();
+        solverConfigure(handle, 3, 30, 500, &api_profile, 1);
+        c_state result;
+        bool solved = solverSolve(handle, api_board, &result);
+        assert(solved && strlen(solverError(handle)) == 0);
+        assert(result.step > 0 && result.combo > 0 && result.row == 5 && result.column == 6);
+
+        // one direction per step from the start, the same route and board
+        c_compact_state compact;
+        solved = solverSolveCompact(handle, api_board, true, true, &compact);
+        assert(solved && compact.step == result.step && compact.combo == result.combo);
+        assert(compact.start == result.routes[0].row * 6 + result.routes[0].column);
+        int at = compact.start;
+        for (int i = 0; i < compact.step; i++) {
+            const int dr[] = {-1, 1, 0, 0};
+            const int dc[] = {0, 0, -1, 1};
+            at += dr[compact.directions[i]] * 6 + dc[compact.directions[i]];
+            assert(at == result.routes[i + 1].row * 6 + result.routes[i + 1].column);
+        }
+        int segment_steps = 0;
+        for (int i = 0; i < compact.segment_count; i++) {
+            assert(i == 0 || compact.segment_directions[i] != compact.segment_directions[i - 1]);
+            segment_steps += compact.segment_lengths[i];
+        }
+        assert(segment_steps == compact.step);
+        int colour_combos = 0;
+        for (int i = 0; i < ORB_COUNT; i++)
+            colour_combos += compact.colour_combo[i];
+        assert(colour_combos == compact.combo);
+        assert(std::equal(result.board.begin(), result.board.begin() + 30, compact.board));
+        // segments and combos by colour are only filled if asked for
+        solved = solverSolveCompact(handle, api_board, false, false, &compact);
+        assert(solved && compact.segment_count == 0 && compact.colour_combo[1] == 0);
+
+        // a bad board is an error instead of exiting, the buffer is untouched
+        result.combo = -1;
+        compact.combo = -1;
+        solved = solverSolve(handle, "RHBDD", &result);
+        assert(!solved && strlen(solverError(handle)) > 0 && result.combo == -1);
+        solved = solverSolveCompact(handle, "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLX", false, false,
+                                    &compact);
+        assert(!solved && strlen(solverError(handle)) > 0 && compact.combo == -1);
+        solved = solverSolve(handle, api_board, &result);
+        assert(solved && strlen(solverError(handle)) == 0 && result.combo > 0);
+        solverFree(handle);
+
+        // a bad job in a batch is rejected on its own
+        c_job api_jobs[] = {{api_board, 3, 30, 500, &api_profile, 1},
+                            {"XYZ", 3, 30, 500, &api_profile, 1}};
+        c_compact_state api_results[2];
+        adventureBatch(api_jobs, 2, 2, api_results, nullptr);
+        assert(!api_results[0].rejected && api_results[0].step == result.step);
+        assert(api_results[1].rejected && api_results[1].step == -1);
+
+        // a background search never starts on a bad board
+        assert(adventureAsync("RHBDD", 3, 30, 500, &api_profile, 1) == nullptr);
+        c_verdict api_verdict;
+        assert(feasibilityEx(api_board, 3, &api_profile, 1, &api_verdict) == 1);
+        assert(feasibilityEx("RHBDD", 3, &api_profile, 1, &api_verdict) == -1);
+        auto api_commit = adventureCommitEx("RHBDD", 3, 30, 500, &api_profile, 1, 0.5, nullptr);
+        assert(api_commit.step == 0 && api_commit.combo == -1);
+        // the shortened route never goes past the buffer
+        const char* api_route = "LLRRDU";
+        char api_shortened[7];
+        assert(shortenEx(api_board, 5, 6, 5, api_route, false, false, 3, api_shortened, 7) == 6);
+        assert(api_shortened[0] == '\0');
+        const char* api_long = "LLDDLULDLDRDRURDLURULLDDLURUR";
+        assert(shortenEx(api_board, 5, 6, 5, api_long, false, false, 3, api_shortened, 7) == -1);
+        assert(api_shortened[0] == '\0');
+        api_shortened[0] = 'X';
+        assert(shortenEx(api_board, 5, 6, 5, api_route, false, false, 3, api_shortened, 0) == -1);
+        assert(api_shortened[0] == 'X');
+    }
+
+    printf("test c api passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Line protocol
+    ///
+
+    printf("test line protocol\n");
+    {
+        pazusoba::solve_request request;
+        std::string error;
+        bool parsed = pazusoba::parse_request(
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL id=x erase=4 depth=30 beam=500 "
+            "diagonal=1 blocked=0,7 deadline=100 profile=combo:7 profile=L::RB",
+            request, error);
+        assert(parsed);
+        assert(request.id == "x" && request.min_erase == 4);
+        assert(request.search_depth == 30 && request.beam_size == 500);
+        assert(request.diagonal && request.deadline == 100);
+        assert(request.blocked.size() == 2 && request.blocked[1] == 7);
+        assert(request.profiles.size() == 2);
+        assert(request.profiles[0].name == pazusoba::target_combo);
+        assert(request.profiles[0].target == 7);
+        assert(request.profiles[1].name == pazusoba::shape_L);
+        assert(request.profiles[1].orbs[1] && request.profiles[1].orbs[2]);
+        assert(!request.profiles[1].orbs[3]);
+
+        // bad lines never reach set_board()
+        const char* bad_lines[] = {
+            "RHB",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLX",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL beam=many",
+            // limits are rejected instead of clamped or overflowing
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL beam=2000000000",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL beam=99999999999",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL depth=151",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL erase=2",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL erase=6",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL blocked=30",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL profile=triangle",
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL colour=5",
+            "depth=10",
+        };
+        for (const char* line : bad_lines) {
+            pazusoba::solve_request bad;
+            parsed = pazusoba::parse_request(line, bad, error);
+            assert(!parsed);
+            assert(!error.empty());
+        }
+
+        // defaults for the bulk mode, lines override them
+        pazusoba::solve_request defaults;
+        parsed = pazusoba::parse_options("depth=20 beam=300 profile=combo:6", defaults, error);
+        assert(parsed && defaults.search_depth == 20 && defaults.profiles.size() == 1);
+        parsed = pazusoba::parse_options("RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL", defaults, error);
+        assert(!parsed);
+        auto overridden = defaults;
+        parsed = pazusoba::parse_request(
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL beam=400 profile=L", overridden, error);
+        assert(parsed && overridden.search_depth == 20 && overridden.beam_size == 400);
+        assert(overridden.profiles.size() == 1);
+        assert(overridden.profiles[0].name == pazusoba::shape_L);
+
+        // the same result as the solver, earlier requests don't change it
+        pazusoba::solve_request plain;
+        parsed = pazusoba::parse_request(
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL depth=30 beam=500", plain, error);
+        assert(parsed);
+        auto plain_solver = pazusoba::solver();
+        plain_solver.set_board(plain.board.c_str());
+        plain_solver.set_search_depth(30);
+        plain_solver.set_beam_size(500);
+        pazusoba::profile plain_profile;
+        plain_profile.name = pazusoba::target_combo;
+        plain_profile.stop_threshold = 100;
+        plain_solver.set_profiles(&plain_profile, 1);
+        auto plain_state = plain_solver.adventure();
+
+        pazusoba::workspace space;
+        pazusoba::solve_request_with(request, space, 1);
+        auto response = pazusoba::solve_request_with(plain, space, 1);
+        assert(response.ok && !response.timed_out);
+        assert(response.score == plain_state.score);
+        assert(response.route == plain_solver.get_route_string(plain_state));
+        std::string line = pazusoba::format_response(response);
+        printf("%s\n", line.c_str());
+        assert(line.compare(0, 8, "ok id=- ") == 0);
+        assert(line.find(" route=" + response.route + " ") != std::string::npos);
+        // long ids are never cut short
+        response.id = std::string(600, 'i');
+        line = pazusoba::format_response(response);
+        assert(line.compare(0, 613, "ok id=" + response.id + " start=") == 0);
+        assert(line.find(" ms=") != std::string::npos);
+
+        // a deadline keeps the best state found before it
+        pazusoba::solve_request late;
+        parsed = pazusoba::parse_request(
+            "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL depth=100 beam=100000 deadline=1",
+            late, error);
+        assert(parsed);
+        (void)parsed;
+        auto late_response = pazusoba::solve_request_with(late, space, 1);
+        assert(late_response.timed_out && late_response.depth < 100);
+        assert(late_response.steps > 0);
+    }
+
+    printf("test line protocol passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Daemon metrics
+    ///
+
+    printf("test daemon metrics\n");
+    {
+        // buckets are found with the portable bit scans
+        assert(pazusoba::bits::highest(1) == 0 && pazusoba::bits::highest(128) == 7);
+        assert(pazusoba::bits::highest(255) == 7 && pazusoba::bits::highest(1ULL << 63) == 63);
+        assert(pazusoba::bits::lowest(1ULL << 41 | 1ULL << 50) == 41);
+        assert(pazusoba::bits::count(0) == 0 && pazusoba::bits::count(~0ULL) == 64);
+
+        // every latency goes into the first bucket whose bound covers it
+        pazusoba::latency_histogram histogram;
+        const long long int latencies[] = {1, 128, 129, 160, 161, 1000, 65536, 33554432};
+        for (long long int micros : latencies) {
+            pazusoba::latency_histogram before;
+            before.record(micros);
+            int index = 0;
+            while (before.bucket(index) == 0)
+                index++;
+            assert(micros <= pazusoba::latency_histogram::bound(index));
+            assert(index == 0 || micros > pazusoba::latency_histogram::bound(index - 1));
+            histogram.record(micros);
+        }
+        // slower than the last bucket is only counted
+        histogram.record(100000000);
+        long long int bucketed = 0;
+        for (int i = 0; i < pazusoba::latency_histogram::BUCKET_COUNT; i++)
+            bucketed += histogram.bucket(i);
+        assert(bucketed == 8 && histogram.count() == 9);
+
+        pazusoba::daemon_metrics metrics;
+        pazusoba::solve_request request;
+        request.board = "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL";
+        request.beam_size = 100;
+        pazusoba::solve_response response;
+        response.ok = true;
+        response.timed_out = true;
+        response.depth = 2;
+        response.expanded = 100;
+        response.ms = 1.5;
+        metrics.received();
+        metrics.received();
+        metrics.rejected();
+        metrics.solved(request, response);
+        std::string text = metrics.text();
+        assert(text.find("pazusoba_requests_total 2\n") != std::string::npos);
+        assert(text.find("pazusoba_rejected_total 1\n") != std::string::npos);
+        assert(text.find("pazusoba_timeouts_total 1\n") != std::string::npos);
+        assert(text.find("pazusoba_beam_occupancy 0.500000\n") != std::string::npos);
+        assert(text.find("pazusoba_solve_seconds_count{size=\"5x6\"} 1\n") != std::string::npos);
+        assert(text.find("pazusoba_solve_seconds_bucket{size=\"5x6\",le=\"0.001536\"} 1\n") !=
+               std::string::npos);
+    }
+
+    printf("test daemon metrics passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Board corpus
+    ///
+
+    printf("test board corpus\n");
+
+    {
+        const char* path = "test_pazusoba_corpus.pzbc";
+        const char* boards[] = {
+            "RHGHDRGLBLHGDBLLHBGBDDLLDHGBBL",
+            "DGRJPLLRDDGRBGJPLBJHRRDLPGHGJB",
+            "RRRGGGBBBLLLDDDHHHRRRGGGBBBLLL",
+        };
+        pazusoba::corpus_writer writer;
+        bool opened = writer.open(path, 5, 6,
+                                  pazusoba::corpus_blocked | pazusoba::corpus_expected_combo);
+        assert(opened);
+        (void)opened;
+        bool added = writer.add(boards[0], 1ULL << 29, 7);
+        added = writer.add(boards[1]) && added;
+        added = writer.add(boards[2], 3, 10) && added;
+        assert(added);
+        (void)added;
+        // every board in a corpus has the same size
+        bool wrong_size = writer.add("RHGHDRGLBLHGDBLLHBGB");
+        assert(!wrong_size);
+        (void)wrong_size;
+        bool closed = writer.close();
+        assert(closed);
+        (void)closed;
+
+        pazusoba::corpus_reader reader;
+        bool read = reader.open(path);
+        assert(read);
+        (void)read;
+        assert(reader.rows() == 5 && reader.columns() == 6);
+        assert(reader.count() == 3);
+        int index = 0;
+        for (auto record : reader) {
+            assert(record.board() == boards[index]);
+            index++;
+        }
+        assert(index == 3);
+        assert(reader[0].blocked_mask() == 1ULL << 29);
+        assert(reader[0].expected_combo() == 7);
+        assert(reader[1].blocked_mask() == 0);
+        assert(reader[1].expected_combo() == -1);
+        assert(reader[2].blocked_mask() == 3);
+        assert(reader[2].expected_combo() == 10);
+
+        pazusoba::game_board board;
+        reader[2].unpack(board);
+        assert(board[0] == 1 && board[29] == 4 && board[30] == 0);
+        reader.close();
+
+        // a corrupt nibble is rejected like a bad orb in a text line
+        FILE* corrupt = fopen(path, "r+b");
+        fseek(corrupt, CORPUS_HEADER_SIZE, SEEK_SET);
+        fputc(0xff, corrupt);
+        fclose(corrupt);
+        read = reader.open(path);
+        assert(read);
+        pazusoba::solve_request request;
+        request.board = reader[0].board();
+        assert(request.board.find('?') != std::string::npos);
+        std::string error;
+        bool valid = pazusoba::validate_request(request, error);
+        assert(!valid && !error.empty());
+        (void)valid;
+        request.board = reader[1].board();
+        valid = pazusoba::validate_request(request, error);
+        assert(valid);
+        reader.close();
+
+        // text files aren't a corpus
+        FILE* text = fopen(path, "w");
+        fputs("RHGHDRGLBLHGDBLLHBGBDDLLDHGBBL\n", text);
+        fclose(text);
+        bool invalid = reader.open(path);
+        assert(!invalid && !reader.error().empty());
+        (void)invalid;
+        remove(path);
+    }
+
+    printf("test board corpus passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Solution cache
+    ///
+
+    printf("test solution cache\n");
+
+    {
+        // mirror every row and swap fire with water
+        auto mirror_swap = [](std::string board) {
+            for (size_t row = 0; row < board.size(); row += 6)
+                std::reverse(board.begin() + row, board.begin() + row + 6);
+            for (auto& c : board)
+                c = c == 'R' ? 'B' : c == 'B' ? 'R' : c;
+            return board;
+        };
+        std::string original = "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL";
+        std::string twin = mirror_swap(original);
+
+        pazusoba::solution_cache cache;
+        bool opened = cache.open("", 64);
+        assert(opened && cache.capacity() == 64);
+        (void)opened;
+
+        pazusoba::profile cache_profile;
+        cache_profile.name = pazusoba::target_combo;
+        auto make = [&](const std::string& board) {
+            auto s = pazusoba::solver();
+            s.set_board(board.c_str());
+            s.set_search_depth(30);
+            s.set_beam_size(500);
+            s.set_profiles(&cache_profile, 1);
+            s.set_cache(&cache);
+            return s;
+        };
+        auto first = make(original);
+        auto first_state = first.adventure();
+        assert(!first.cached() && cache.size() == 1);
+
+        // the twin is answered by replaying the mirrored route
+        auto second = make(twin);
+        auto second_state = second.adventure();
+        assert(second.cached() && cache.hits() == 1);
+        assert(second_state.combo == first_state.combo);
+        assert(second_state.step == first_state.step);
+        assert(second_state.begin / 6 == first_state.begin / 6);
+        assert(second_state.begin % 6 == 5 - first_state.begin % 6);
+        std::string mirrored = first.get_route_string(first_state);
+        for (auto& c : mirrored)
+            c = c == 'L' ? 'R' : c == 'R' ? 'L' : c;
+        assert(second.get_route_string(second_state) == mirrored);
+
+        // fire can't be swapped once a profile asks for it
+        cache_profile.orbs[1] = true;
+        auto picky = make(twin);
+        picky.adventure();
+        assert(!picky.cached());
+        cache_profile.orbs[1] = false;
+
+        // shapes share the cache with their own settings
+        pazusoba::shape_request shape;
+        shape.shape = pazusoba::shape_full_row;
+        std::array<bool, MAX_BOARD_LENGTH> open_cells{};
+        auto row_result = pazusoba::solve_shape(original, 5, 6, shape, open_cells, &cache);
+        auto row_twin = pazusoba::solve_shape(twin, 5, 6, shape, open_cells, &cache);
+        assert(row_twin.note == "cached");
+        assert(row_twin.success == row_result.success && row_twin.steps == row_result.steps);
+        if (row_result.success) {
+            assert(row_twin.final_board == mirror_swap(row_result.final_board));
+            assert(row_twin.color == (row_result.color == 1   ? 2
+                                      : row_result.color == 2 ? 1
+                                                              : row_result.color));
+        }
+
+        // one set of 8, the least recently used board goes first
+        pazusoba::solution_cache small;
+        opened = small.open("", 1);
+        assert(opened && small.capacity() == CACHE_WAYS);
+        pazusoba::game_board small_board{};
+        std::array<bool, MAX_BOARD_LENGTH> none{};
+        pazusoba::cached_solution found;
+        for (int i = 0; i <= CACHE_WAYS; i++) {
+            small_board[0] = 1;
+            small_board[1 + i] = 1;
+            pazusoba::cached_solution solution;
+            solution.directions.push_back(pazusoba::down);
+            small.store(pazusoba::canonical_board(small_board, 5, 6, none, nullptr), 1, solution);
+            small_board[1 + i] = 0;
+            // keep the first board in use
+            small_board[1] = 1;
+            bool hit = small.find(pazusoba::canonical_board(small_board, 5, 6, none, nullptr), 1,
+                                  found);
+            assert(hit);
+            (void)hit;
+            small_board[1] = 0;
+        }
+        assert(small.size() == CACHE_WAYS && small.evictions() == 1);
+        small_board[0] = 1;
+        small_board[2] = 1;
+        bool evicted = !small.find(pazusoba::canonical_board(small_board, 5, 6, none, nullptr), 1,
+                                   found);
+        assert(evicted);
+        (void)evicted;
+
+        // entries survive closing the file
+        const char* path = "test_pazusoba_cache.bin";
+        remove(path);
+        pazusoba::solution_cache saved;
+        opened = saved.open(path, 16);
+        assert(opened);
+        auto saving = make(original);
+        saving.set_cache(&saved);
+        saving.adventure();
+        saved.close();
+        opened = saved.open(path, 1000);
+        assert(opened && saved.capacity() == 16 && saved.size() == 1);
+        saving.adventure();
+        assert(saving.cached());
+        // the file is locked until it is closed
+        pazusoba::solution_cache other;
+        bool shared = other.open(path, 16);
+        assert(!shared && !other.error().empty());
+        (void)shared;
+        saved.close();
+        shared = other.open(path, 16);
+        assert(shared && other.size() == 1);
+        other.close();
+        remove(path);
+    }
+
+    printf("test solution cache passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Shape candidates
+    ///
+
+    printf("test shape candidates\n");
+    {
+        std::array<bool, MAX_BOARD_LENGTH> open_cells{};
+        const char* boards[] = {"DGRRBLHGBBGGRDDDDLBGHDBLLHDBLD",
+                                "RBGRBGGRBRGBBGRRBGGBRBRGRBBGRG"};
+        for (const char* board : boards) {
+            for (int kind = pazusoba::shape_3x3_square; kind <= pazusoba::shape_full_column;
+                 kind++) {
+                pazusoba::shape_request request;
+                request.shape = kind;
+                request.threads = 1;
+                auto serial = pazusoba::solve_shape(board, 5, 6, request, open_cells);
+                // more threads pick the same candidate
+                request.threads = 4;
+                auto parallel = pazusoba::solve_shape(board, 5, 6, request, open_cells);
+                assert(parallel.success == serial.success);
+                assert(parallel.route == serial.route && parallel.start == serial.start);
+                assert(parallel.note == serial.note);
+
+                // any route does, but it has to be one
+                request.first_feasible = true;
+                auto first = pazusoba::solve_shape(board, 5, 6, request, open_cells);
+                assert(first.success == serial.success);
+                if (first.success) {
+                    assert(first.combo <= serial.combo);
+                    assert(pazusoba::board_has_shape(first.final_board, 5, 6, kind));
+                }
+
+                // searching back from the goals finds the same candidates
+                request.first_feasible = false;
+                request.bidirectional = true;
+                for (int diagonal = 0; diagonal < 2; diagonal++) {
+                    request.allow_diagonal = diagonal;
+                    auto both = pazusoba::solve_shape(board, 5, 6, request, open_cells);
+                    assert(diagonal || both.success == serial.success);
+                    assert(!both.success ||
+                           pazusoba::board_has_shape(both.final_board, 5, 6, kind));
+                    (void)both;
+                }
+            }
+        }
+
+        // placements are worked out once for every kind and size
+        const auto& squares = pazusoba::shape_placements(pazusoba::shape_3x3_square, 5, 6);
+        assert(&squares == &pazusoba::shape_placements(pazusoba::shape_3x3_square, 5, 6));
+        assert(squares.size() == 12 && squares[0].cells.size() == 9);
+        // the top left square touches 3 cells on its right and 3 below
+        assert(squares[0].mask == 0x71c7ULL && squares[0].border == 0x1c8208ULL);
+        (void)squares;
+
+        // letters are checked once instead of exiting in set_board()
+        pazusoba::shape_request request;
+        auto invalid = pazusoba::solve_shape("DGRRBLHGBBGGRDDDDLBGHDBLLHDBLX", 5, 6, request);
+        assert(!invalid.success && invalid.note == "invalid orb");
+    }
+    printf("test shape candidates passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Shape A* and IDA*
+    ///
+
+    printf("test shape astar and ida\n");
+    {
+        // the first orb and the last orb can't move
+        std::array<bool, MAX_BOARD_LENGTH> blocked{};
+        blocked[0] = blocked[29] = true;
+        const char* board = "RBGRBGGRBRGBBGRRBGGBRBRGRBBGRG";
+        for (int kind = pazusoba::shape_3x3_square; kind <= pazusoba::shape_full_column; kind++) {
+            for (int diagonal = 0; diagonal < 2; diagonal++) {
+                pazusoba::shape_request request;
+                request.shape = kind;
+                request.allow_diagonal = diagonal;
+                request.threads = 1;
+                auto constructive = pazusoba::solve_shape(board, 5, 6, request, blocked);
+                request.search = pazusoba::shape_astar;
+                auto astar = pazusoba::solve_shape(board, 5, 6, request, blocked);
+                assert(astar.success && constructive.success);
+                assert(pazusoba::board_has_shape(astar.final_board, 5, 6, kind));
+                assert(astar.final_board[0] == board[0] && astar.final_board[29] == board[29]);
+                assert(astar.steps == (int)astar.route.size());
+                assert(astar.steps <= request.max_steps);
+                // how long the routes are next to the constructive ones is
+                // measured by benchmark_3x3_schemes --compare
+
+                // depth first with a table of a few states, starts split
+                // over threads don't change the route
+                request.search = pazusoba::shape_ida;
+                request.table_entries = 4096;
+                auto ida = pazusoba::solve_shape(board, 5, 6, request, blocked);
+                request.threads = 3;
+                auto split = pazusoba::solve_shape(board, 5, 6, request, blocked);
+                assert(ida.success && pazusoba::board_has_shape(ida.final_board, 5, 6, kind));
+                assert(ida.final_board[0] == board[0] && ida.final_board[29] == board[29]);
+                assert(ida.steps == (int)ida.route.size() && ida.steps <= request.max_steps);
+                assert(split.route == ida.route && split.start == ida.start);
+                (void)constructive;
+                (void)split;
+            }
+        }
+
+        // the finger has to get behind an orb to push it, the orb below
+        // the first one needs 3 moves to go right but only 2 with diagonals
+        const auto& pattern = pazusoba::shape_patterns(5, 6, false);
+        assert(&pattern == &pazusoba::shape_patterns(5, 6, false));
+        assert(pattern(6, 0, 1) == 3 && pattern(2, 0, 1) == 2);
+        // a held orb just follows the finger
+        assert(pattern(0, 0, 1) == 1 && pattern(0, 0, 29) == 9 && pattern(17, 4, 4) == 0);
+        assert(pazusoba::shape_patterns(5, 6, true)(6, 0, 1) == 2);
+        (void)pattern;
+
+        // nothing left to expand gives up instead of searching forever
+        pazusoba::shape_request request;
+        request.shape = pazusoba::shape_3x3_square;
+        request.search = pazusoba::shape_astar;
+        request.node_limit = 10;
+        auto limited = pazusoba::solve_shape(board, 5, 6, request);
+        assert(!limited.success && limited.note == "A* node limit reached");
+        (void)limited;
+    }
+    printf("test shape astar and ida passed\n");
+    printf("====================================\n");
+
+    ///
+    /// Board evaluation
+    ///
+
+    printf("test board evaluation\n");
+    {
+        // the same as the solver for its own profiles
+        auto evaluated = pazusoba::solver();
+        evaluated.set_board("DGRRBLHGBBGGRDDDDLBGHDBLLHDBLD");
+        pazusoba::profile combo_profile;
+        combo_profile.name = pazusoba::target_combo;
+        evaluated.set_profiles(&combo_profile, 1);
+        auto copy = evaluated.board();
+        pazusoba::state solver_state;
+        solver_state.step = 5;
+        evaluated.evaluate(copy, solver_state);
+
+        pazusoba::evaluation_plan plan;
+        plan.profiles = &combo_profile;
+        plan.count = 1;
+        plan.verdicts = evaluated.verdicts().data();
+        plan.goal_count = 1;
+        plan.step = 5;
+        plan.max_combo = evaluated.max_combo();
+        auto result = pazusoba::evaluate_board(evaluated.board(), 5, 6, 3, &plan);
+        assert(result.combo == solver_state.combo && result.score == solver_state.score);
+        assert(result.goal == solver_state.goal);
+        // green falls into a second combo
+        assert(result.combo == 2 && result.rounds == 2 && result.colour_combo[3] == 1);
+        assert(result.remaining == 23);
+
+        // a 3x3 square away from the top row
+        evaluated.set_board("BGBGBGBGBGBGRRRBGBRRRBGBRRRBGB");
+        pazusoba::profile square_profile;
+        square_profile.name = pazusoba::shape_square;
+        square_profile.orbs[1] = true;
+        plan.profiles = &square_profile;
+        plan.verdicts = nullptr;
+        auto square = pazusoba::evaluate_board(evaluated.board(), 5, 6, 3, &plan);
+        assert(square.goal && square.colour_combo[1] == 1 && square.erased[1] == 9);
+        (void)result;
+        (void)square;
+    }
+    printf("test board evaluation passed\n");
+    printf("====================================\n");
+
     ///
     /// Move orbs down
     ///
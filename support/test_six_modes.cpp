@@ -1,3 +1,5 @@
+// every test is an assert, keep them in release builds too
+#undef NDEBUG
 #include <pazusoba/core.h>
 
 #include <cassert>
@@ -139,6 +141,47 @@ void test_target_combo_multicolor_requirement() {
     assert(state.score > 0);
 }
 
+void test_profile_feasibility() {
+    pazusoba::solver solver;
+    solver.set_board("RRRBBBGGGLLLDDDHHHRRBBGGLDDHHL");
+    pazusoba::profile profiles[4];
+    profiles[0].name = pazusoba::target_combo;
+    profiles[0].target = 8;
+    profiles[1].name = pazusoba::connected_orb;
+    profiles[1].target = 7;
+    profiles[1].orbs[1] = true;  // R
+    profiles[2].name = pazusoba::shape_square;
+    profiles[2].orbs[1] = true;  // R
+    profiles[3].name = pazusoba::colour;
+    profiles[3].orbs[7] = true;  // J
+    solver.set_profiles(profiles, 4);
+
+    const auto& verdicts = solver.verdicts();
+    assert(!verdicts[0].feasible && verdicts[0].relaxed);
+    assert(verdicts[0].target == solver.max_combo());
+    assert(!verdicts[1].feasible && verdicts[1].relaxed);
+    assert(verdicts[1].target == 5);
+    assert(!verdicts[2].feasible && !verdicts[2].relaxed);
+    assert(!verdicts[3].feasible && !verdicts[3].relaxed);
+    assert(solver.feasible());
+    (void)verdicts;
+
+    // impossible shapes don't stop max combo from being the goal
+    pazusoba::profile mixed[2];
+    mixed[0].name = pazusoba::target_combo;
+    mixed[1] = profiles[2];
+    solver.set_profiles(mixed, 2);
+    auto board = solver.board();
+    pazusoba::state state;
+    solver.evaluate(board, state);
+    assert(state.combo == 6);
+    assert(state.goal);
+
+    solver.set_profiles(mixed + 1, 1);
+    assert(!solver.feasible());
+    assert(solver.adventure().step == 0);
+}
+
 void test_shape(int kind, const std::string& board, int rows, int cols) {
     pazusoba::shape_request request;
     request.shape = kind;
@@ -201,6 +244,7 @@ int main() {
     test_diagonal_expand();
     test_connected_orb_multicolor();
     test_target_combo_multicolor_requirement();
+    test_profile_feasibility();
 
     std::string board_6x5 = "RRHRRBLRRBGDLHDRHBBGRGDDLRGBHL";
     test_shape(pazusoba::shape_3x3_square, board_6x5, 5, 6);
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""
+Test the reusable Solver handle of the shared library
+
+PAZUSOBA_LIBRARY=build/libpazusoba.so python3 support/test_solver.py
+"""
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from pazusoba import Profile, ProfileName, Solver, adventureBatch, feasibilityEx
+
+BOARD = "RHBDDRRGHDGBHGBGHHRLLRGBBHHRLL"
+
+
+def test_round_trip():
+    """One handle solves a board twice, in both result forms"""
+    with Solver(3, 30, 500, [Profile(name=ProfileName.COMBO, threshold=100)]) as solver:
+        state = solver.solve(BOARD)
+        assert state.step > 0 and state.combo > 0
+        assert (state.row, state.column) == (5, 6)
+
+        compact = solver.solve_compact(BOARD)
+        assert compact.step == state.step and compact.combo == state.combo
+        assert len(compact.route) == compact.step
+        assert sum(length for _, length in compact.segments) == compact.step
+        assert sum(compact.colour_combo) == compact.combo
+        assert (state.routes[0].row, state.routes[0].column) == compact.start
+    assert solver.handle is None
+    print("test round trip passed")
+
+
+def test_bad_board():
+    """A rejected board raises instead of ending the process"""
+    with Solver(3, 30, 500, [Profile(name=ProfileName.COMBO, threshold=100)]) as solver:
+        for board in ["RHBDD", BOARD[:-1] + "X"]:
+            try:
+                solver.solve(board)
+                assert False, "{} was accepted".format(board)
+            except ValueError as error:
+                assert str(error)
+        # the handle still works afterwards
+        assert solver.solve(BOARD).combo > 0
+    print("test bad board passed")
+
+
+def test_batch_rejects():
+    """A bad board in a batch is flagged and the other boards are solved"""
+    profiles = [Profile(name=ProfileName.COMBO, threshold=100)]
+    results = adventureBatch([BOARD, "XYZ"], 3, 30, 500, profiles, 2)
+    assert not results[0].rejected and results[0].step > 0
+    assert results[1].rejected and results[1].step == -1 and results[1].route == ""
+    print("test batch rejects passed")
+
+
+def test_feasibility_rejects():
+    """Checking profiles against a bad board raises instead of ending the process"""
+    profiles = [Profile(name=ProfileName.COMBO, threshold=100)]
+    assert feasibilityEx(BOARD, 3, profiles)[0].feasible
+    try:
+        feasibilityEx("XYZ", 3, profiles)
+        assert False, "XYZ was accepted"
+    except ValueError:
+        pass
+    print("test feasibility rejects passed")
+
+
+if __name__ == "__main__":
+    test_round_trip()
+    test_bad_board()
+    test_batch_rejects()
+    test_feasibility_rejects()